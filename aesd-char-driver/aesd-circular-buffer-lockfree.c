@@ -0,0 +1,157 @@
+/**
+ * @file aesd-circular-buffer-lockfree.c
+ * @brief Lock-free single/multi producer, single consumer variant of the aesd circular buffer
+ *
+ * Each slot carries a sequence number in the style of Dmitry Vyukov's bounded queue, so
+ * multiple producers can claim positions with a compare and swap on head and publish them
+ * independently, while the consumer only ever sees fully written entries.
+ */
+
+#include <string.h>
+#include "aesd-circular-buffer-lockfree.h"
+
+#define AESD_LF_MASK (AESD_LF_CIRCULAR_BUFFER_SIZE - 1)
+
+_Static_assert((AESD_LF_CIRCULAR_BUFFER_SIZE & AESD_LF_MASK) == 0,
+        "AESD_LF_CIRCULAR_BUFFER_SIZE must be a power of 2");
+
+/**
+* Initializes the buffer described by @param buffer to an empty ring.
+* Must complete before any producer or consumer uses the buffer.
+*/
+void aesd_lf_circular_buffer_init(struct aesd_lf_circular_buffer *buffer)
+{
+    uint64_t pos;
+
+    memset(buffer, 0, sizeof(struct aesd_lf_circular_buffer));
+    for (pos = 0; pos < AESD_LF_CIRCULAR_BUFFER_SIZE; pos++) {
+        atomic_init(&buffer->slot[pos].seq, pos);
+    }
+    atomic_init(&buffer->head, 0);
+    atomic_init(&buffer->tail, 0);
+}
+
+/**
+* Publish @param add_entry from the only producer thread of @param buffer.
+* @return false without adding the entry if the buffer is full.
+*/
+bool aesd_lf_circular_buffer_add_entry_spsc(struct aesd_lf_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entry)
+{
+    uint64_t pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    struct aesd_lf_slot *slot = &buffer->slot[pos & AESD_LF_MASK];
+
+    // The consumer releases the slot for this lap by storing pos
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos) {
+        return false;
+    }
+    aesd_buffer_entry_copy(&slot->entry, add_entry);
+    atomic_store_explicit(&buffer->head, pos + 1, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+/**
+* Publish @param add_entry from any of several producer threads of @param buffer.
+* @return false without adding the entry if the buffer is full.
+*/
+bool aesd_lf_circular_buffer_add_entry_mpsc(struct aesd_lf_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entry)
+{
+    uint64_t pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    struct aesd_lf_slot *slot;
+    int64_t diff;
+
+    for (;;) {
+        slot = &buffer->slot[pos & AESD_LF_MASK];
+        diff = (int64_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+        if (diff == 0) {
+            // Slot is free for this lap, claim the position
+            if (atomic_compare_exchange_weak_explicit(&buffer->head, &pos, pos + 1,
+                        memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return false; // The consumer has not released the slot yet, buffer is full
+        }
+        else {
+            // Another producer claimed pos first
+            pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+        }
+    }
+
+    aesd_buffer_entry_copy(&slot->entry, add_entry);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+/**
+* Remove the oldest published entry from @param buffer into @param entry_rtn.  Consumer thread only.
+* Ownership of any memory referenced by the entry passes to the caller.
+* @return false if no entry has been published.
+*/
+bool aesd_lf_circular_buffer_remove_entry(struct aesd_lf_circular_buffer *buffer,
+            struct aesd_buffer_entry *entry_rtn)
+{
+    uint64_t pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    struct aesd_lf_slot *slot = &buffer->slot[pos & AESD_LF_MASK];
+
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) {
+        return false;
+    }
+    aesd_buffer_entry_copy(entry_rtn, &slot->entry);
+    atomic_store_explicit(&buffer->tail, pos + 1, memory_order_relaxed);
+    // Hand the slot back to producers for the next lap
+    atomic_store_explicit(&slot->seq, pos + AESD_LF_CIRCULAR_BUFFER_SIZE, memory_order_release);
+    return true;
+}
+
+/**
+* Same as aesd_circular_buffer_find_entry_offset_for_fpos, over the published entries starting at
+* the oldest.  Consumer thread only.  With multiple producers the search stops at the first position
+* which was claimed but not yet published.
+*/
+struct aesd_buffer_entry *aesd_lf_circular_buffer_find_entry_offset_for_fpos(
+            struct aesd_lf_circular_buffer *buffer, size_t char_offset, size_t *entry_offset_byte_rtn)
+{
+    uint64_t pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    uint64_t end = pos + AESD_LF_CIRCULAR_BUFFER_SIZE;
+    size_t cumulative_length = 0;
+    struct aesd_lf_slot *slot;
+
+    for (; pos < end; pos++) {
+        slot = &buffer->slot[pos & AESD_LF_MASK];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) {
+            break;
+        }
+        if (char_offset < cumulative_length + slot->entry.size) {
+            if (entry_offset_byte_rtn) {
+                *entry_offset_byte_rtn = char_offset - cumulative_length;
+            }
+            return &slot->entry;
+        }
+        cumulative_length += slot->entry.size;
+    }
+    return NULL;
+}
+
+/**
+* @return the sum of the sizes of the published entries in @param buffer.  Consumer thread only.
+*/
+size_t aesd_lf_circular_buffer_entries_total_size(struct aesd_lf_circular_buffer *buffer)
+{
+    uint64_t pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    uint64_t end = pos + AESD_LF_CIRCULAR_BUFFER_SIZE;
+    size_t total_size = 0;
+    struct aesd_lf_slot *slot;
+
+    for (; pos < end; pos++) {
+        slot = &buffer->slot[pos & AESD_LF_MASK];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) {
+            break;
+        }
+        total_size += slot->entry.size;
+    }
+    return total_size;
+}
@@ -0,0 +1,71 @@
+/*
+ * aesd-circular-buffer-lockfree.h
+ *
+ * Lock-free variant of aesd_circular_buffer for sharing a ring between userspace threads
+ * without a mutex.  Producers either follow the single producer protocol
+ * (aesd_lf_circular_buffer_add_entry_spsc) or the multi producer protocol
+ * (aesd_lf_circular_buffer_add_entry_mpsc), never both on the same buffer.  A single
+ * consumer thread removes entries and may search the published entries by offset.
+ *
+ * Unlike aesd_circular_buffer, a full buffer rejects new entries instead of overwriting
+ * the oldest, since the consumer may still be reading it.
+ */
+
+#ifndef AESD_CIRCULAR_BUFFER_LOCKFREE_H
+#define AESD_CIRCULAR_BUFFER_LOCKFREE_H
+
+#ifdef __KERNEL__
+#error "aesd-circular-buffer-lockfree is a userspace only variant of aesd-circular-buffer"
+#endif
+
+#include <stdatomic.h>
+#include "aesd-circular-buffer.h"
+
+#ifndef AESD_LF_CIRCULAR_BUFFER_SIZE
+#define AESD_LF_CIRCULAR_BUFFER_SIZE 16 // must be a power of 2
+#endif
+
+#ifndef AESD_CACHE_LINE_SIZE
+#define AESD_CACHE_LINE_SIZE 64
+#endif
+
+struct aesd_lf_slot
+{
+    /**
+     * Publication state of the slot for ring position pos: pos while free for a producer,
+     * pos + 1 once the entry is published to the consumer.
+     */
+    _Atomic uint64_t seq;
+    struct aesd_buffer_entry entry;
+};
+
+struct aesd_lf_circular_buffer
+{
+    /**
+     * Next ring position to be claimed by a producer
+     */
+    _Alignas(AESD_CACHE_LINE_SIZE) _Atomic uint64_t head;
+    /**
+     * Next ring position to be removed by the consumer
+     */
+    _Alignas(AESD_CACHE_LINE_SIZE) _Atomic uint64_t tail;
+    _Alignas(AESD_CACHE_LINE_SIZE) struct aesd_lf_slot slot[AESD_LF_CIRCULAR_BUFFER_SIZE];
+};
+
+extern void aesd_lf_circular_buffer_init(struct aesd_lf_circular_buffer *buffer);
+
+extern bool aesd_lf_circular_buffer_add_entry_spsc(struct aesd_lf_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entry);
+
+extern bool aesd_lf_circular_buffer_add_entry_mpsc(struct aesd_lf_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entry);
+
+extern bool aesd_lf_circular_buffer_remove_entry(struct aesd_lf_circular_buffer *buffer,
+            struct aesd_buffer_entry *entry_rtn);
+
+extern struct aesd_buffer_entry *aesd_lf_circular_buffer_find_entry_offset_for_fpos(
+            struct aesd_lf_circular_buffer *buffer, size_t char_offset, size_t *entry_offset_byte_rtn);
+
+extern size_t aesd_lf_circular_buffer_entries_total_size(struct aesd_lf_circular_buffer *buffer);
+
+#endif /* AESD_CIRCULAR_BUFFER_LOCKFREE_H */
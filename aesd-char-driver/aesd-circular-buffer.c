@@ -16,6 +16,9 @@
 
 #include "aesd-circular-buffer.h"
 
+_Static_assert(sizeof(struct aesd_buffer_entry) == AESD_BUFFER_ENTRY_SIZE,
+        "struct aesd_buffer_entry should occupy exactly one cache line");
+
 /**
  * References:
  *   1. ChatGPT:
@@ -79,6 +82,9 @@ struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct
 * new start location.
 * Any necessary locking must be handled by the caller
 * Any memory referenced in @param add_entry must be allocated by and/or must have a lifetime managed by the caller.
+* Inline data is copied into the buffer.
+* @return the buffptr of the overwritten entry for the caller to free, or NULL if no entry was overwritten
+* or the overwritten entry was stored inline.
 */
 const char* aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry)
 {
@@ -97,12 +103,17 @@ const char* aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer,
     if (buffer->full) {
         // If so, overwrite the oldest entry and advance out_offs
         buffer->out_offs = (buffer->out_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+        buffer->out_seq++;
 
-        replaced_buffer = buffer->entry[buffer->in_offs].buffptr;
+        if (!aesd_buffer_entry_is_inline(&buffer->entry[buffer->in_offs])) {
+            replaced_buffer = buffer->entry[buffer->in_offs].buffptr;
+        }
     }
 
     // Copy the content of add_entry into the buffer at in_offs
-    buffer->entry[buffer->in_offs] = *add_entry;
+    aesd_buffer_entry_copy(&buffer->entry[buffer->in_offs], add_entry);
+    buffer->entry[buffer->in_offs].stream_offs = buffer->stream_size;
+    buffer->stream_size += add_entry->size;
 
     // Update in_offs for the next write operation
     buffer->in_offs = (buffer->in_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
@@ -126,6 +137,94 @@ size_t aesd_circular_buffer_entries_total_size(struct aesd_circular_buffer *buff
     return total_size;
 }
 
+/**
+* @return the number of valid entries in @param buffer.
+* Any necessary locking must be performed by caller.
+*/
+uint8_t aesd_circular_buffer_entry_count(const struct aesd_circular_buffer *buffer)
+{
+    if (buffer->full) {
+        return AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    }
+    return (buffer->in_offs + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->out_offs) %
+            AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+}
+
+/**
+* @param index the zero referenced entry to return, counted from the oldest entry in @param buffer
+* @return the entry at @param index, or NULL if fewer than index + 1 entries are stored.
+* Any necessary locking must be performed by caller.
+*/
+struct aesd_buffer_entry *aesd_circular_buffer_get_entry(struct aesd_circular_buffer *buffer, size_t index)
+{
+    if (index >= aesd_circular_buffer_entry_count(buffer)) {
+        return NULL;
+    }
+    return &buffer->entry[(buffer->out_offs + index) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+}
+
+/**
+* @param seq the sequence number of the entry to find, see aesd_circular_buffer.out_seq
+* @param char_offset_rtn is a pointer specifying a location to store the zero referenced character index of
+*      the first byte of the returned entry if all buffer strings were concatenated end to end, the value
+*      aesd_circular_buffer_find_entry_offset_for_fpos would need to find it.  Only set when found.
+* @return the entry with sequence number @param seq, or NULL if it was evicted or not yet added.
+* Any necessary locking must be performed by caller.
+*/
+struct aesd_buffer_entry *aesd_circular_buffer_find_entry_for_seq(struct aesd_circular_buffer *buffer,
+            uint64_t seq, size_t *char_offset_rtn)
+{
+    struct aesd_buffer_entry *entry;
+
+    if ((seq < buffer->out_seq) || (seq - buffer->out_seq >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)) {
+        return NULL;
+    }
+    entry = aesd_circular_buffer_get_entry(buffer, seq - buffer->out_seq);
+    if ((entry != NULL) && (char_offset_rtn != NULL)) {
+        *char_offset_rtn = entry->stream_offs - buffer->entry[buffer->out_offs].stream_offs;
+    }
+    return entry;
+}
+
+/**
+* Store @param size bytes of @param data inline in @param entry and point buffptr at them.
+* @return false, leaving @param entry unchanged, if size exceeds AESD_BUFFER_ENTRY_INLINE_SIZE.
+*/
+bool aesd_buffer_entry_set_inline(struct aesd_buffer_entry *entry, const char *data, size_t size)
+{
+    if (size > AESD_BUFFER_ENTRY_INLINE_SIZE) {
+        return false;
+    }
+    memcpy(entry->inline_data, data, size);
+    entry->buffptr = entry->inline_data;
+    entry->size = size;
+    return true;
+}
+
+/**
+* @return true if the data of @param entry is stored in its inline_data member
+*/
+bool aesd_buffer_entry_is_inline(const struct aesd_buffer_entry *entry)
+{
+    return entry->buffptr == entry->inline_data;
+}
+
+/**
+* Copy @param src to @param dst, pointing dst->buffptr at dst's own inline data if src was inline.
+*/
+void aesd_buffer_entry_copy(struct aesd_buffer_entry *dst, const struct aesd_buffer_entry *src)
+{
+    if (aesd_buffer_entry_is_inline(src)) {
+        dst->buffptr = dst->inline_data;
+        dst->size = src->size;
+        dst->stream_offs = src->stream_offs;
+        memcpy(dst->inline_data, src->inline_data, src->size);
+    }
+    else {
+        *dst = *src;
+    }
+}
+
 /**
 * Initializes the circular buffer described by @param buffer to an empty struct
 */
@@ -10,25 +10,49 @@
 
 #ifdef __KERNEL__
 #include <linux/types.h>
+typedef u64 aesd_stream_offs_t; // printed with %llu, which u64 always is in the kernel
 #else
 #include <stddef.h> // size_t
 #include <stdint.h> // uintx_t
 #include <stdbool.h>
+typedef uint64_t aesd_stream_offs_t;
 #endif
 
-#define AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED 10
+#ifndef AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
+#define AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED 10 // at most 255, in_offs and out_offs are uint8_t
+#endif
+
+/**
+ * Each entry occupies one cache line.  Records which fit in the space left over after the
+ * entry members on a 64 bit build are stored inline, avoiding a separate allocation and pointer
+ * chase.  The inline size is fixed rather than derived from sizeof() so it is the same for
+ * 32 bit userspace and a 64 bit kernel, see struct aesd_mmap_slot.
+ */
+#define AESD_BUFFER_ENTRY_SIZE        64
+#define AESD_BUFFER_ENTRY_INLINE_SIZE 40
 
 struct aesd_buffer_entry
 {
     /**
-     * A location where the buffer contents in buffptr are stored
+     * A location where the buffer contents in buffptr are stored, either memory owned by the
+     * caller or inline_data of this entry
      */
     const char *buffptr;
     /**
      * Number of bytes stored in buffptr
      */
     size_t size;
-};
+    /**
+     * Offset of the first byte of this entry if every entry ever added to the buffer were
+     * concatenated end to end.  Assigned by aesd_circular_buffer_add_entry.
+     */
+    aesd_stream_offs_t stream_offs;
+    /**
+     * Storage for records of up to AESD_BUFFER_ENTRY_INLINE_SIZE bytes, used when buffptr
+     * points here.  Copy entries with aesd_buffer_entry_copy so buffptr follows the copy.
+     */
+    char inline_data[AESD_BUFFER_ENTRY_INLINE_SIZE];
+} __attribute__((aligned(AESD_BUFFER_ENTRY_SIZE)));
 
 struct aesd_circular_buffer
 {
@@ -49,6 +73,15 @@ struct aesd_circular_buffer
      * set to true when the buffer entry structure is full
      */
     bool full;
+    /**
+     * Sequence number of the entry at out_offs.  Entries are numbered from 0 in the order
+     * they are added, so the entry index positions after out_offs has sequence out_seq + index.
+     */
+    uint64_t out_seq;
+    /**
+     * Total bytes ever added to the buffer, the stream_offs of the next entry
+     */
+    aesd_stream_offs_t stream_size;
 };
 
 extern struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct aesd_circular_buffer *buffer,
@@ -58,8 +91,21 @@ extern const char* aesd_circular_buffer_add_entry(struct aesd_circular_buffer *b
 
 extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
 
+extern bool aesd_buffer_entry_set_inline(struct aesd_buffer_entry *entry, const char *data, size_t size);
+
+extern bool aesd_buffer_entry_is_inline(const struct aesd_buffer_entry *entry);
+
+extern void aesd_buffer_entry_copy(struct aesd_buffer_entry *dst, const struct aesd_buffer_entry *src);
+
 extern size_t aesd_circular_buffer_entries_total_size(struct aesd_circular_buffer *buffer);
 
+extern uint8_t aesd_circular_buffer_entry_count(const struct aesd_circular_buffer *buffer);
+
+extern struct aesd_buffer_entry *aesd_circular_buffer_get_entry(struct aesd_circular_buffer *buffer, size_t index);
+
+extern struct aesd_buffer_entry *aesd_circular_buffer_find_entry_for_seq(struct aesd_circular_buffer *buffer,
+            uint64_t seq, size_t *char_offset_rtn);
+
 /**
  * Create a for loop to iterate over each member of the circular buffer.
  * Useful when you've allocated memory for circular buffer entries and need to free it
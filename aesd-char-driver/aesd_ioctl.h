@@ -18,6 +18,8 @@
 #include <stdint.h>
 #endif
 
+#include "aesd-circular-buffer.h"
+
 /**
  * A structure to be passed by IOCTL from user space to kernel space, describing the type
  * of seek performed on the aesdchar driver
@@ -33,14 +35,153 @@ struct aesd_seekto {
     uint32_t write_cmd_offset;
 };
 
+/**
+ * Seek to a write command by its sequence number.  Every write command committed to the device
+ * is numbered from 0 in order, so a consumer can record the sequence number of the last command
+ * it processed and resume from the next one later, even after older commands were evicted.
+ */
+struct aesd_seekseq {
+    /**
+     * Sequence number of the write command to seek into.  If that command was already evicted the
+     * driver seeks to the oldest retained command and updates this field with its sequence number.
+     * The sequence number one past the newest command seeks to the end of the data.
+     */
+    uint64_t seq;
+    /**
+     * The zero referenced offset within the write
+     */
+    uint32_t seq_offset;
+    uint32_t reserved;
+};
+
+/**
+ * One destination buffer for AESDCHAR_IOCGETRECORDS
+ */
+struct aesd_record_iovec {
+    /**
+     * Userspace address of the destination buffer
+     */
+    uint64_t base;
+    /**
+     * Size of the destination buffer in bytes
+     */
+    uint64_t len;
+    /**
+     * Set by the driver to the full size of the record, which may exceed len
+     */
+    uint64_t size;
+};
+
+/**
+ * Fetch up to count records, starting at write command first_cmd, in a single call
+ */
+struct aesd_records_request {
+    /**
+     * The zero referenced write command of the first record, as in aesd_seekto
+     */
+    uint32_t first_cmd;
+    /**
+     * Number of elements in the iov array
+     */
+    uint32_t count;
+    /**
+     * Userspace address of an array of count struct aesd_record_iovec
+     */
+    uint64_t iov;
+    /**
+     * Set by the driver to the number of records copied
+     */
+    uint32_t returned;
+    uint32_t reserved;
+};
+
+/**
+ * Geometry of the ring, returned by AESDCHAR_IOCGETSTATS
+ */
+struct aesd_stats {
+    /**
+     * Number of valid entries, and the size of each in write command order
+     */
+    uint32_t entry_count;
+    uint32_t max_entries;
+    uint64_t total_bytes;
+    uint64_t entry_size[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    /**
+     * Sequence number of the oldest entry, see struct aesd_seekseq
+     */
+    uint64_t first_seq;
+};
+
 // Pick an arbitrary unused value from https://github.com/torvalds/linux/blob/master/Documentation/userspace-api/ioctl/ioctl-number.rst
 #define AESD_IOC_MAGIC 0x16
 
 // Define a write command from the user point of view, use command number 1
 #define AESDCHAR_IOCSEEKTO _IOWR(AESD_IOC_MAGIC, 1, struct aesd_seekto)
+#define AESDCHAR_IOCGETRECORDS _IOWR(AESD_IOC_MAGIC, 2, struct aesd_records_request)
+#define AESDCHAR_IOCGETSTATS _IOR(AESD_IOC_MAGIC, 3, struct aesd_stats)
+#define AESDCHAR_IOCSEEKSEQ _IOWR(AESD_IOC_MAGIC, 4, struct aesd_seekseq)
 /**
  * The maximum number of commands supported, used for bounds checking
  */
-#define AESDCHAR_IOC_MAXNR 1
+#define AESDCHAR_IOC_MAXNR 4
+
+/**
+ * Layout of the read-only mapping returned by mmap() on an aesd char device.
+ * Offset 0 holds a struct aesd_mmap_header.  The data of ring slot N is found at slot[N].data_offset:
+ * short records are copied into slot[N].inline_data of the header itself, others are mapped at
+ * (N + 1) * AESD_MMAP_SLOT_SIZE.  Only the first slot[N].size bytes of that window are backed,
+ * entries larger than the window are truncated to AESD_MMAP_SLOT_SIZE in the mapping.
+ * Records stored compressed (see the aesd_compress_threshold module parameter) are not mapped and
+ * have a data_offset of 0, read them with read() or AESDCHAR_IOCGETRECORDS instead.
+ */
+#define AESD_MMAP_MAGIC     0x41455344  /* "AESD" */
+#define AESD_MMAP_VERSION   3
+#define AESD_MMAP_SLOT_SIZE (1UL << 20)
+#define AESD_MMAP_LENGTH    ((AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED + 1) * AESD_MMAP_SLOT_SIZE)
+
+struct aesd_mmap_slot {
+    /**
+     * Number of bytes stored in this slot, 0 if the slot is empty
+     */
+    uint64_t size;
+    /**
+     * Offset of the slot data from the start of the mapping, 0 if the slot is stored compressed
+     */
+    uint64_t data_offset;
+    /**
+     * Copy of the record when it is stored inline in the ring entry
+     */
+    char inline_data[AESD_BUFFER_ENTRY_INLINE_SIZE];
+};
+
+struct aesd_mmap_header {
+    uint32_t magic;
+    uint32_t version;
+    /**
+     * Incremented before and after every update of the header.  Readers should retry
+     * while the value is odd or changed between the start and end of their read.
+     */
+    uint32_t generation;
+    /**
+     * Number of valid entries in the ring
+     */
+    uint32_t entry_count;
+    /**
+     * Copies of the circular buffer in_offs, out_offs and full members
+     */
+    uint32_t in_offs;
+    uint32_t out_offs;
+    uint32_t full;
+    uint32_t max_entries;
+    /**
+     * Sum of the sizes of all valid entries
+     */
+    uint64_t total_size;
+    struct aesd_mmap_slot slot[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    /**
+     * Sequence number of the entry at out_offs, see struct aesd_seekseq
+     */
+    uint64_t out_seq;
+};
 
 #endif /* AESD_IOCTL_H */
@@ -0,0 +1,51 @@
+/*
+ * aesd_snapshot.h
+ *
+ *  @brief Binary image of an aesdchar ring, read from debugfs <debugfs>/aesdchar/<minor>/snapshot
+ *  and written back to <debugfs>/aesdchar/<minor>/restore after the module is reloaded.
+ *
+ *  The image is a struct aesd_snapshot_header followed by entry_count records, each a
+ *  struct aesd_snapshot_record followed by size bytes of data padded to a multiple of
+ *  AESD_SNAPSHOT_ALIGN.  All fields are in the byte order of the machine which wrote the image.
+ */
+
+#ifndef AESD_SNAPSHOT_H
+#define AESD_SNAPSHOT_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#define AESD_SNAPSHOT_MAGIC   0x53534541  /* "AESS" */
+#define AESD_SNAPSHOT_VERSION 1
+#define AESD_SNAPSHOT_ALIGN   8
+
+struct aesd_snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    /**
+     * Number of records following the header, oldest first
+     */
+    uint32_t entry_count;
+    uint32_t reserved;
+    /**
+     * Sequence number of the first record, restored so consumers resuming by sequence
+     * number (AESDCHAR_IOCSEEKSEQ) continue where they left off
+     */
+    uint64_t first_seq;
+    /**
+     * Stream offset of the first record, see aesd_buffer_entry.stream_offs
+     */
+    uint64_t first_stream_offs;
+};
+
+struct aesd_snapshot_record {
+    /**
+     * Number of data bytes following this record, excluding padding
+     */
+    uint64_t size;
+};
+
+#endif /* AESD_SNAPSHOT_H */
@@ -0,0 +1,109 @@
+/*
+ * aesd_trace.h
+ *
+ *  @brief Tracepoints for the aesdchar file operations, enabled through
+ *  <tracefs>/events/aesdchar/.  lock_wait_ns is the time the operation spent waiting for the
+ *  device and file mutexes.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM aesdchar
+
+#if !defined(AESD_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define AESD_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(aesd_open,
+    TP_PROTO(unsigned int minor, int ret),
+    TP_ARGS(minor, ret),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->ret = ret;
+    ),
+    TP_printk("minor=%u ret=%d", __entry->minor, __entry->ret)
+);
+
+DECLARE_EVENT_CLASS(aesd_rw,
+    TP_PROTO(unsigned int minor, size_t count, loff_t pos, ssize_t ret, u64 lock_wait_ns),
+    TP_ARGS(minor, count, pos, ret, lock_wait_ns),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(size_t, count)
+        __field(loff_t, pos)
+        __field(ssize_t, ret)
+        __field(u64, lock_wait_ns)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->count = count;
+        __entry->pos = pos;
+        __entry->ret = ret;
+        __entry->lock_wait_ns = lock_wait_ns;
+    ),
+    TP_printk("minor=%u count=%zu pos=%lld ret=%zd lock_wait_ns=%llu", __entry->minor, __entry->count,
+        __entry->pos, __entry->ret, __entry->lock_wait_ns)
+);
+
+DEFINE_EVENT(aesd_rw, aesd_read,
+    TP_PROTO(unsigned int minor, size_t count, loff_t pos, ssize_t ret, u64 lock_wait_ns),
+    TP_ARGS(minor, count, pos, ret, lock_wait_ns)
+);
+
+DEFINE_EVENT(aesd_rw, aesd_write,
+    TP_PROTO(unsigned int minor, size_t count, loff_t pos, ssize_t ret, u64 lock_wait_ns),
+    TP_ARGS(minor, count, pos, ret, lock_wait_ns)
+);
+
+TRACE_EVENT(aesd_llseek,
+    TP_PROTO(unsigned int minor, loff_t off, int whence, loff_t ret, u64 lock_wait_ns),
+    TP_ARGS(minor, off, whence, ret, lock_wait_ns),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(loff_t, off)
+        __field(int, whence)
+        __field(loff_t, ret)
+        __field(u64, lock_wait_ns)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->off = off;
+        __entry->whence = whence;
+        __entry->ret = ret;
+        __entry->lock_wait_ns = lock_wait_ns;
+    ),
+    TP_printk("minor=%u off=%lld whence=%d ret=%lld lock_wait_ns=%llu", __entry->minor, __entry->off,
+        __entry->whence, __entry->ret, __entry->lock_wait_ns)
+);
+
+TRACE_EVENT(aesd_ioctl,
+    TP_PROTO(unsigned int minor, unsigned int cmd, long ret, u64 lock_wait_ns),
+    TP_ARGS(minor, cmd, ret, lock_wait_ns),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(unsigned int, cmd)
+        __field(long, ret)
+        __field(u64, lock_wait_ns)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->cmd = cmd;
+        __entry->ret = ret;
+        __entry->lock_wait_ns = lock_wait_ns;
+    ),
+    TP_printk("minor=%u cmd=0x%x ret=%ld lock_wait_ns=%llu", __entry->minor, __entry->cmd,
+        __entry->ret, __entry->lock_wait_ns)
+);
+
+#endif /* AESD_TRACE_H */
+
+/* This part must be outside the include guard, see include/trace/define_trace.h */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE aesd_trace
+#include <trace/define_trace.h>
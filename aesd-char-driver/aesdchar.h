@@ -10,7 +10,7 @@
 
 #include "aesd-circular-buffer.h"
 
-#define AESD_DEBUG 1  //Remove comment on this line to enable debug
+/* AESD_DEBUG is defined by the Makefile when built with DEBUG=y */
 
 #undef PDEBUG             /* undef it, just in case */
 #ifdef AESD_DEBUG
@@ -25,16 +25,143 @@
 #  define PDEBUG(fmt, args...) /* not debugging: nothing */
 #endif
 
+#ifndef AESD_NR_DEVS
+#define AESD_NR_DEVS 4    /* minors 0 through 3, see aesdchar_load */
+#endif
+
+/**
+ * Number of lines aesd_write prepares before committing them to the ring under one lock hold
+ */
+#define AESD_WRITE_BATCH 8
+
+/**
+ * File operations timed by aesd_op_record, see the debugfs latency file
+ */
+enum aesd_op {
+    AESD_OP_OPEN,
+    AESD_OP_READ,
+    AESD_OP_WRITE,
+    AESD_OP_LLSEEK,
+    AESD_OP_IOCTL,
+    AESD_OP_COUNT,
+};
+
+/**
+ * Latency histogram buckets, bucket n counts operations taking [2^(n-1), 2^n) ns.  The last
+ * bucket also counts anything slower.
+ */
+#define AESD_LATENCY_BUCKETS 32
+
+struct aesd_op_stats
+{
+    atomic64_t count;
+    atomic64_t errors;
+    /**
+     * Bytes transferred by successful reads and writes
+     */
+    atomic64_t bytes;
+    atomic64_t total_ns;
+    /**
+     * Part of total_ns spent waiting for the device and file mutexes
+     */
+    atomic64_t lock_wait_ns;
+    atomic64_t latency_hist[AESD_LATENCY_BUCKETS];
+};
+
 struct aesd_dev
 {
     /**
      * TODO: Add structure(s) and locks needed to complete assignment requirements
      */
+    /**
+     * Partial (not newline terminated) write left behind by a released file, adopted by the
+     * next file which writes to the device.  Protected by circular_buffer_mutex.
+     */
     struct aesd_buffer_entry cached_entry;
     struct aesd_circular_buffer circular_buffer;
     struct mutex circular_buffer_mutex;
+    /**
+     * Page shared read-only with userspace describing the ring, see struct aesd_mmap_header
+     */
+    struct aesd_mmap_header *mmap_header;
+    /**
+     * Inode of the device node mapped by userspace, used to zap stale slot mappings
+     * when an entry is replaced.  Holds a reference while set.
+     */
+    struct inode *mmap_inode;
+    /**
+     * Serializes the mmap fault handler against replacement of ring entries.  Taken inside
+     * circular_buffer_mutex, never held across copy_to_user/copy_from_user.
+     */
+    struct mutex mmap_mutex;
+    /**
+     * Total bytes dropped from the head of the ring since the device was created
+     */
+    uint64_t evicted_bytes;
+    /**
+     * Number of entries committed to the ring since the device was created
+     */
+    uint64_t commit_count;
+    /**
+     * Readers waiting in aesd_read or aesd_poll for a new entry to be committed
+     */
+    wait_queue_head_t read_queue;
+    /**
+     * Ring slots whose buffptr holds a struct aesd_compressed_buf rather than the record itself.
+     * Protected by circular_buffer_mutex.
+     */
+    DECLARE_BITMAP(compressed_slots, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+    /**
+     * Most recently decompressed record, so a record read in several chunks is only decompressed
+     * once.  Identified by the stream_offs of the record.  Protected by circular_buffer_mutex.
+     */
+    char *decompressed_buf;
+    size_t decompressed_buf_size;
+    aesd_stream_offs_t decompressed_stream_offs;
+    bool decompressed_valid;
+    struct crypto_comp *decompress_tfm;
+    /**
+     * Records compressed since the device was created, with their total size before and after
+     */
+    atomic64_t compressed_entries;
+    atomic64_t compressed_input_bytes;
+    atomic64_t compressed_output_bytes;
+    /**
+     * Counters and latency histograms, updated without locking
+     */
+    struct aesd_op_stats op_stats[AESD_OP_COUNT];
+    /**
+     * debugfs directory of this device, holding the snapshot, restore and latency files
+     */
+    struct dentry *debugfs_dir;
     struct cdev cdev;     /* Char device structure      */
 };
 
+/**
+ * Per open file state, stored in filp->private_data
+ */
+struct aesd_file
+{
+    struct aesd_dev *dev;
+    /**
+     * Value of dev->evicted_bytes when f_pos was last synchronized with the ring.  Used to
+     * keep f_pos pointing at the same data as older entries are dropped.
+     */
+    uint64_t evicted_bytes;
+    /**
+     * Write data received on this file which is not yet newline terminated
+     */
+    struct aesd_buffer_entry pending;
+    /**
+     * Serializes writers sharing this file, protects pending
+     */
+    struct mutex pending_mutex;
+    /**
+     * Compress transform for records written on this file, allocated on first use.
+     * Protected by pending_mutex.
+     */
+    struct crypto_comp *compress_tfm;
+};
+
 
 #endif /* AESD_CHAR_DRIVER_AESDCHAR_H_ */
@@ -0,0 +1,152 @@
+/**
+ * @file aesd-circular-buffer-bench.c
+ * @brief Microbenchmarks for the circular buffer used by the aesdchar driver
+ *
+ * Times aesd_circular_buffer_add_entry, aesd_circular_buffer_find_entry_offset_for_fpos and
+ * aesd_circular_buffer_entries_total_size for several entry size distributions.  The ring
+ * capacity is fixed at compile time by AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, see
+ * CMakeLists.txt for the capacities built.
+ *
+ * Usage: aesd-circular-buffer-bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "aesd-circular-buffer.h"
+
+#define DEFAULT_ITERATIONS 1000000UL
+#define ENTRY_POOL_SIZE    4096 // power of 2, entries are drawn from the pool in order
+#define MAX_ENTRY_SIZE     4096
+
+/**
+ * Defeats dead code elimination of the results of the functions under test
+ */
+static volatile size_t bench_sink;
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+static uint32_t bench_rand(void)
+{
+    // xorshift64, fixed seed so every run measures the same sequence
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32);
+}
+
+static size_t size_fixed_small(void)
+{
+    return 16;
+}
+
+static size_t size_uniform(void)
+{
+    return 1 + bench_rand() % 256;
+}
+
+static size_t size_bimodal(void)
+{
+    // Mostly short command lines with the occasional large paste
+    return (bench_rand() % 10 == 0) ? MAX_ENTRY_SIZE : 32;
+}
+
+struct size_distribution {
+    const char *name;
+    size_t (*next_size)(void);
+};
+
+static const struct size_distribution distributions[] = {
+    { "fixed-16", size_fixed_small },
+    { "uniform-1-256", size_uniform },
+    { "bimodal-32-4096", size_bimodal },
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *op, const char *distribution, unsigned long iterations, double elapsed_ns)
+{
+    printf("%-16s %-16s %4d %12lu %10.2f\n", op, distribution, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+            iterations, elapsed_ns / iterations);
+}
+
+static void bench_distribution(const struct size_distribution *distribution, unsigned long iterations,
+            struct aesd_buffer_entry *pool, const char *backing)
+{
+    struct aesd_circular_buffer buffer;
+    size_t total_size;
+    size_t entry_offset;
+    size_t sum = 0;
+    unsigned long i;
+    double start;
+
+    for (i = 0; i < ENTRY_POOL_SIZE; i++) {
+        pool[i].buffptr = backing;
+        pool[i].size = distribution->next_size();
+    }
+
+    aesd_circular_buffer_init(&buffer);
+    start = now_ns();
+    for (i = 0; i < iterations; i++) {
+        bench_sink = (size_t)aesd_circular_buffer_add_entry(&buffer, &pool[i & (ENTRY_POOL_SIZE - 1)]);
+    }
+    report("add_entry", distribution->name, iterations, now_ns() - start);
+
+    // The buffer is full after the loop above, search it at random character offsets
+    total_size = aesd_circular_buffer_entries_total_size(&buffer);
+    start = now_ns();
+    for (i = 0; i < iterations; i++) {
+        struct aesd_buffer_entry *entry = aesd_circular_buffer_find_entry_offset_for_fpos(&buffer,
+                    bench_rand() % total_size, &entry_offset);
+        sum += entry->size + entry_offset;
+    }
+    report("find_for_fpos", distribution->name, iterations, now_ns() - start);
+
+    start = now_ns();
+    for (i = 0; i < iterations; i++) {
+        sum += aesd_circular_buffer_entries_total_size(&buffer);
+    }
+    report("total_size", distribution->name, iterations, now_ns() - start);
+
+    bench_sink = sum;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long iterations = DEFAULT_ITERATIONS;
+    struct aesd_buffer_entry *pool;
+    char *backing;
+    size_t i;
+
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 0);
+        if (iterations == 0) {
+            fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    pool = calloc(ENTRY_POOL_SIZE, sizeof(*pool));
+    backing = malloc(MAX_ENTRY_SIZE);
+    if ((pool == NULL) || (backing == NULL)) {
+        fprintf(stderr, "ERROR: Failed to malloc\n");
+        return 1;
+    }
+    memset(backing, 'a', MAX_ENTRY_SIZE);
+
+    printf("%-16s %-16s %4s %12s %10s\n", "op", "sizes", "cap", "iterations", "ns/op");
+    for (i = 0; i < sizeof(distributions) / sizeof(distributions[0]); i++) {
+        bench_distribution(&distributions[i], iterations, pool, backing);
+    }
+
+    free(backing);
+    free(pool);
+    return 0;
+}
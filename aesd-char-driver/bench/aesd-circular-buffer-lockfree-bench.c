@@ -0,0 +1,138 @@
+/**
+ * @file aesd-circular-buffer-lockfree-bench.c
+ * @brief Throughput of the lock-free ring against the same ring guarded by a pthread mutex
+ *
+ * Each producer thread pushes a fixed number of entries while one consumer removes them.
+ *
+ * Usage: aesd-circular-buffer-lockfree-bench [producers] [entries per producer]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "aesd-circular-buffer-lockfree.h"
+
+#define DEFAULT_PRODUCERS 4
+#define DEFAULT_ENTRIES   1000000UL
+
+enum bench_mode {
+    BENCH_LOCKFREE,
+    BENCH_MUTEX,
+};
+
+struct bench_ctx {
+    struct aesd_lf_circular_buffer buffer;
+    pthread_mutex_t mutex;
+    enum bench_mode mode;
+    int producers;
+    unsigned long entries;
+};
+
+static bool bench_add(struct bench_ctx *ctx, const struct aesd_buffer_entry *entry)
+{
+    bool added;
+
+    if (ctx->mode == BENCH_LOCKFREE) {
+        if (ctx->producers == 1) {
+            return aesd_lf_circular_buffer_add_entry_spsc(&ctx->buffer, entry);
+        }
+        return aesd_lf_circular_buffer_add_entry_mpsc(&ctx->buffer, entry);
+    }
+    pthread_mutex_lock(&ctx->mutex);
+    added = aesd_lf_circular_buffer_add_entry_spsc(&ctx->buffer, entry);
+    pthread_mutex_unlock(&ctx->mutex);
+    return added;
+}
+
+static bool bench_remove(struct bench_ctx *ctx, struct aesd_buffer_entry *entry)
+{
+    bool removed;
+
+    if (ctx->mode == BENCH_LOCKFREE) {
+        return aesd_lf_circular_buffer_remove_entry(&ctx->buffer, entry);
+    }
+    pthread_mutex_lock(&ctx->mutex);
+    removed = aesd_lf_circular_buffer_remove_entry(&ctx->buffer, entry);
+    pthread_mutex_unlock(&ctx->mutex);
+    return removed;
+}
+
+static void *producer(void *arg)
+{
+    struct bench_ctx *ctx = arg;
+    struct aesd_buffer_entry entry = { .buffptr = "x\n", .size = 2 };
+    unsigned long i;
+
+    for (i = 0; i < ctx->entries; i++) {
+        while (!bench_add(ctx, &entry)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static double run(struct bench_ctx *ctx)
+{
+    pthread_t threads[ctx->producers];
+    struct aesd_buffer_entry entry;
+    unsigned long remaining = ctx->entries * ctx->producers;
+    struct timespec start, end;
+    int i;
+
+    aesd_lf_circular_buffer_init(&ctx->buffer);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < ctx->producers; i++) {
+        pthread_create(&threads[i], NULL, producer, ctx);
+    }
+    while (remaining > 0) {
+        if (bench_remove(ctx, &entry)) {
+            remaining--;
+        }
+        else {
+            // Let the producers run, spinning here starves them when they share a CPU
+            sched_yield();
+        }
+    }
+    for (i = 0; i < ctx->producers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_ctx *ctx;
+    double seconds;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        fprintf(stderr, "ERROR: Failed to malloc\n");
+        return 1;
+    }
+    ctx->producers = (argc > 1) ? atoi(argv[1]) : DEFAULT_PRODUCERS;
+    ctx->entries = (argc > 2) ? strtoul(argv[2], NULL, 0) : DEFAULT_ENTRIES;
+    if ((ctx->producers <= 0) || (ctx->entries == 0)) {
+        fprintf(stderr, "Usage: %s [producers] [entries per producer]\n", argv[0]);
+        free(ctx);
+        return 1;
+    }
+    pthread_mutex_init(&ctx->mutex, NULL);
+
+    ctx->mode = BENCH_LOCKFREE;
+    seconds = run(ctx);
+    printf("%-10s producers=%d %8.2f Mentries/s\n", (ctx->producers == 1) ? "spsc" : "mpsc",
+            ctx->producers, ctx->entries * ctx->producers / seconds / 1e6);
+
+    ctx->mode = BENCH_MUTEX;
+    seconds = run(ctx);
+    printf("%-10s producers=%d %8.2f Mentries/s\n", "mutex", ctx->producers,
+            ctx->entries * ctx->producers / seconds / 1e6);
+
+    pthread_mutex_destroy(&ctx->mutex);
+    free(ctx);
+    return 0;
+}
@@ -0,0 +1,328 @@
+/**
+ * @file aesdchar-mock-bench.c
+ * @brief Multithreaded stress and throughput benchmark of the aesdchar file operations
+ *
+ * Runs main.c in userspace on top of the kernel mock in mock/.  Writer threads each write
+ * numbered records to one device while reader threads repeatedly read the ring from the start
+ * and check every record they see is intact and in order for its writer.  At the end the rate
+ * of each operation and the driver's own latency statistics from debugfs are printed.
+ *
+ * Usage: aesdchar-mock-bench [-w writers] [-r readers] [-t seconds] [-s record size]
+ *                            [-l records per write] [-c compress threshold]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "kmock.h"
+#include "aesdchar.h"
+#include "aesd_ioctl.h"
+
+#define DEFAULT_WRITERS     2
+#define DEFAULT_READERS     2
+#define DEFAULT_SECONDS     2
+#define DEFAULT_RECORD_SIZE 64
+#define MIN_RECORD_SIZE     32 // room for the record header written by format_record
+#define STATS_INTERVAL      64 // reader passes between AESDCHAR_IOCGETSTATS checks
+#define MAX_WRITERS         64
+
+/* Defined in main.c, which has no header for them */
+extern int aesd_nr_devs;
+extern unsigned int aesd_compress_threshold;
+extern struct aesd_dev *aesd_devices;
+extern struct file_operations aesd_fops;
+extern int aesd_init_module(void);
+extern void aesd_cleanup_module(void);
+
+struct bench_config {
+    int writers;
+    int readers;
+    int seconds;
+    size_t record_size;
+    int records_per_write;
+    unsigned int compress_threshold;
+};
+
+struct bench_thread {
+    pthread_t thread;
+    int id;
+    const struct bench_config *config;
+    unsigned long ops;
+    unsigned long bytes;
+    unsigned long errors;
+};
+
+static atomic_bool bench_stop;
+static struct inode bench_inode;
+
+static int bench_open(struct file *filp)
+{
+    memset(filp, 0, sizeof(struct file));
+    filp->f_inode = &bench_inode;
+    return aesd_fops.open(&bench_inode, filp);
+}
+
+/**
+ * Write record @param seq of @param writer into @param buf, @param size bytes ending in a newline
+ */
+static void format_record(char *buf, size_t size, int writer, unsigned long seq)
+{
+    int len = snprintf(buf, size, "w%02d %020lu ", writer, seq);
+
+    memset(&buf[len], 'a' + writer % 26, size - len - 1);
+    buf[size - 1] = '\n';
+}
+
+/**
+ * @return true if the @param size bytes at @param buf are a record written by format_record,
+ * storing its writer and sequence number in @param writer and @param seq
+ */
+static bool parse_record(const char *buf, size_t size, const struct bench_config *config, int *writer,
+            unsigned long *seq)
+{
+    size_t i;
+    int len;
+
+    if ((size != config->record_size) || (buf[size - 1] != '\n')) {
+        return false;
+    }
+    if ((sscanf(buf, "w%02d %020lu %n", writer, seq, &len) != 2) || (*writer < 0) ||
+        (*writer >= config->writers)) {
+        return false;
+    }
+    for (i = len; i < size - 1; i++) {
+        if (buf[i] != 'a' + *writer % 26) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *writer_thread(void *arg)
+{
+    struct bench_thread *thread = arg;
+    const struct bench_config *config = thread->config;
+    size_t write_size = config->record_size * config->records_per_write;
+    unsigned long seq = 0;
+    struct file filp;
+    ssize_t written;
+    char *buf;
+    int i;
+
+    buf = malloc(write_size);
+    if ((buf == NULL) || bench_open(&filp)) {
+        thread->errors++;
+        free(buf);
+        return NULL;
+    }
+    while (!atomic_load_explicit(&bench_stop, memory_order_relaxed)) {
+        for (i = 0; i < config->records_per_write; i++) {
+            format_record(&buf[i * config->record_size], config->record_size, thread->id, seq++);
+        }
+        written = aesd_fops.write(&filp, buf, write_size, &filp.f_pos);
+        if (written != (ssize_t)write_size) {
+            thread->errors++;
+            break;
+        }
+        thread->ops++;
+        thread->bytes += written;
+    }
+    aesd_fops.release(&bench_inode, &filp);
+    free(buf);
+    return NULL;
+}
+
+static void check_stats(struct bench_thread *thread, struct file *filp)
+{
+    struct aesd_stats stats;
+
+    if (aesd_fops.unlocked_ioctl(filp, AESDCHAR_IOCGETSTATS, (unsigned long)&stats) ||
+        (stats.entry_count > stats.max_entries)) {
+        thread->errors++;
+    }
+}
+
+static void *reader_thread(void *arg)
+{
+    struct bench_thread *thread = arg;
+    const struct bench_config *config = thread->config;
+    unsigned long last_seq[MAX_WRITERS];
+    bool seen[MAX_WRITERS];
+    unsigned long passes = 0;
+    unsigned long seq;
+    struct file filp;
+    ssize_t result;
+    int writer;
+    char *buf;
+
+    // Larger than any record, so every read returns exactly one whole record
+    buf = malloc(config->record_size * 2);
+    if ((buf == NULL) || bench_open(&filp)) {
+        thread->errors++;
+        free(buf);
+        return NULL;
+    }
+    while (!atomic_load_explicit(&bench_stop, memory_order_relaxed)) {
+        if (aesd_fops.llseek(&filp, 0, SEEK_SET) != 0) {
+            thread->errors++;
+            break;
+        }
+        memset(seen, 0, sizeof(seen));
+        while ((result = aesd_fops.read(&filp, buf, config->record_size * 2, &filp.f_pos)) > 0) {
+            thread->ops++;
+            thread->bytes += result;
+            if (!parse_record(buf, result, config, &writer, &seq)) {
+                fprintf(stderr, "reader %d: corrupt record of %zd bytes\n", thread->id, result);
+                thread->errors++;
+                continue;
+            }
+            // Records of one writer are committed in order, so they appear in order in the ring
+            if (seen[writer] && (seq <= last_seq[writer])) {
+                fprintf(stderr, "reader %d: writer %d record %lu after %lu\n", thread->id, writer,
+                        seq, last_seq[writer]);
+                thread->errors++;
+            }
+            seen[writer] = true;
+            last_seq[writer] = seq;
+        }
+        if (result < 0) {
+            thread->errors++;
+        }
+        if (++passes % STATS_INTERVAL == 0) {
+            check_stats(thread, &filp);
+        }
+    }
+    aesd_fops.release(&bench_inode, &filp);
+    free(buf);
+    return NULL;
+}
+
+static void report(const char *name, struct bench_thread *threads, int count, double seconds,
+            unsigned long *errors)
+{
+    unsigned long ops = 0;
+    unsigned long bytes = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        ops += threads[i].ops;
+        bytes += threads[i].bytes;
+        *errors += threads[i].errors;
+    }
+    printf("%-8s threads=%-3d %12.0f ops/s %10.2f MB/s\n", name, count, ops / seconds,
+            bytes / seconds / 1e6);
+}
+
+static void print_debugfs(const char *path)
+{
+    const struct file_operations *fops;
+    struct file filp;
+    char buf[4096];
+    ssize_t len;
+
+    fops = kmock_debugfs_open(path, &filp);
+    if (fops == NULL) {
+        return;
+    }
+    printf("\n%s:\n", path);
+    while ((len = fops->read(&filp, buf, sizeof(buf), &filp.f_pos)) > 0) {
+        fwrite(buf, 1, len, stdout);
+    }
+    fops->release(filp.f_inode, &filp);
+}
+
+static int usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-w writers] [-r readers] [-t seconds] [-s record size] "
+            "[-l records per write] [-c compress threshold]\n", name);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_config config = {
+        .writers = DEFAULT_WRITERS,
+        .readers = DEFAULT_READERS,
+        .seconds = DEFAULT_SECONDS,
+        .record_size = DEFAULT_RECORD_SIZE,
+        .records_per_write = 1,
+    };
+    struct bench_thread *writers;
+    struct bench_thread *readers;
+    struct timespec start, end;
+    unsigned long errors = 0;
+    double seconds;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "w:r:t:s:l:c:")) != -1) {
+        switch (opt) {
+        case 'w': config.writers = atoi(optarg); break;
+        case 'r': config.readers = atoi(optarg); break;
+        case 't': config.seconds = atoi(optarg); break;
+        case 's': config.record_size = strtoul(optarg, NULL, 0); break;
+        case 'l': config.records_per_write = atoi(optarg); break;
+        case 'c': config.compress_threshold = strtoul(optarg, NULL, 0); break;
+        default: return usage(argv[0]);
+        }
+    }
+    if ((config.writers <= 0) || (config.writers > MAX_WRITERS) || (config.readers < 0) ||
+        (config.seconds <= 0) || (config.record_size < MIN_RECORD_SIZE) || (config.records_per_write <= 0)) {
+        return usage(argv[0]);
+    }
+
+    aesd_nr_devs = 1;
+    aesd_compress_threshold = config.compress_threshold;
+    if (aesd_init_module()) {
+        fprintf(stderr, "ERROR: aesd_init_module failed\n");
+        return 1;
+    }
+    bench_inode.i_cdev = &aesd_devices[0].cdev;
+
+    writers = calloc(config.writers, sizeof(struct bench_thread));
+    readers = calloc(config.readers + 1, sizeof(struct bench_thread));
+    if ((writers == NULL) || (readers == NULL)) {
+        fprintf(stderr, "ERROR: Failed to malloc\n");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < config.writers; i++) {
+        writers[i].id = i;
+        writers[i].config = &config;
+        pthread_create(&writers[i].thread, NULL, writer_thread, &writers[i]);
+    }
+    for (i = 0; i < config.readers; i++) {
+        readers[i].id = i;
+        readers[i].config = &config;
+        pthread_create(&readers[i].thread, NULL, reader_thread, &readers[i]);
+    }
+    sleep(config.seconds);
+    atomic_store(&bench_stop, true);
+    for (i = 0; i < config.writers; i++) {
+        pthread_join(writers[i].thread, NULL);
+    }
+    for (i = 0; i < config.readers; i++) {
+        pthread_join(readers[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    report("write", writers, config.writers, seconds, &errors);
+    report("read", readers, config.readers, seconds, &errors);
+    print_debugfs("aesdchar/0/latency");
+    if (config.compress_threshold != 0) {
+        print_debugfs("aesdchar/0/compression");
+    }
+
+    aesd_cleanup_module();
+    free(writers);
+    free(readers);
+    if (errors != 0) {
+        fprintf(stderr, "FAILED: %lu errors\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -18,75 +18,325 @@
  */
 
 #include <linux/module.h>
+#include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/printk.h>
 #include <linux/types.h>
 #include <linux/cdev.h>
 #include <linux/fs.h> // file_operations
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/crypto.h>
 #include "aesdchar.h"
 #include "aesd_ioctl.h"
+#include "aesd_snapshot.h"
+
+#define CREATE_TRACE_POINTS
+#include "aesd_trace.h"
 
 int aesd_major =   0; // use dynamic major
 int aesd_minor =   0;
+int aesd_nr_devs = AESD_NR_DEVS; // number of device minors, each with its own ring
+bool aesd_blocking_read = false; // return 0 at end of data unless enabled
+unsigned int aesd_compress_threshold = 0; // records of at least this many bytes are stored LZ4 compressed, 0 disables
+
+#define AESD_COMPRESS_ALG "lz4"
+
+module_param(aesd_nr_devs, int, S_IRUGO);
+MODULE_PARM_DESC(aesd_nr_devs, "Number of aesdchar devices to create");
+module_param(aesd_blocking_read, bool, S_IRUGO);
+MODULE_PARM_DESC(aesd_blocking_read, "Block reads at end of data until a new entry is written");
+module_param(aesd_compress_threshold, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(aesd_compress_threshold, "Store records of at least this many bytes LZ4 compressed, 0 to disable");
 
 MODULE_AUTHOR("Mubeena Udyavar Kazi"); /** TODO: fill in your name **/
 MODULE_LICENSE("Dual BSD/GPL");
 
-struct aesd_dev aesd_device;
+struct aesd_dev *aesd_devices; // allocated in aesd_init_module
+static struct dentry *aesd_debugfs_root;
+
+static const char * const aesd_op_names[AESD_OP_COUNT] = {
+    [AESD_OP_OPEN] = "open",
+    [AESD_OP_READ] = "read",
+    [AESD_OP_WRITE] = "write",
+    [AESD_OP_LLSEEK] = "llseek",
+    [AESD_OP_IOCTL] = "ioctl",
+};
+
+/**
+ * Account one @param op on @param dev which started at @param start_ns and returned @param ret
+ */
+static void aesd_op_record(struct aesd_dev *dev, enum aesd_op op, u64 start_ns, long ret,
+            size_t bytes, u64 lock_wait_ns)
+{
+    struct aesd_op_stats *stats = &dev->op_stats[op];
+    u64 elapsed_ns = ktime_get_ns() - start_ns;
+
+    atomic64_inc(&stats->count);
+    if (ret < 0) {
+        atomic64_inc(&stats->errors);
+    }
+    atomic64_add(bytes, &stats->bytes);
+    atomic64_add(elapsed_ns, &stats->total_ns);
+    atomic64_add(lock_wait_ns, &stats->lock_wait_ns);
+    atomic64_inc(&stats->latency_hist[min_t(unsigned int, fls64(elapsed_ns), AESD_LATENCY_BUCKETS - 1)]);
+}
+
+/**
+ * mutex_lock_interruptible on @param lock, adding the time spent waiting to @param lock_wait_ns
+ */
+static int aesd_lock_interruptible(struct mutex *lock, u64 *lock_wait_ns)
+{
+    u64 start_ns = ktime_get_ns();
+    int result = mutex_lock_interruptible(lock);
+
+    *lock_wait_ns += ktime_get_ns() - start_ns;
+    return result;
+}
+
+/**
+ * mutex_lock on @param lock, adding the time spent waiting to @param lock_wait_ns
+ */
+static void aesd_lock(struct mutex *lock, u64 *lock_wait_ns)
+{
+    u64 start_ns = ktime_get_ns();
+
+    mutex_lock(lock);
+    *lock_wait_ns += ktime_get_ns() - start_ns;
+}
+
+/**
+ * Allocate a transform of the crypto compress API for AESD_COMPRESS_ALG.  The algorithm module is
+ * only loaded once compression is enabled, so the driver itself doesn't depend on it.
+ * @return the transform, or NULL if the algorithm isn't available
+ */
+static struct crypto_comp *aesd_compress_tfm_alloc(void)
+{
+    struct crypto_comp *tfm = crypto_alloc_comp(AESD_COMPRESS_ALG, 0, 0);
+
+    return IS_ERR(tfm) ? NULL : tfm;
+}
+
+static void aesd_compress_tfm_free(struct crypto_comp *tfm)
+{
+    if (tfm != NULL) {
+        crypto_free_comp(tfm);
+    }
+}
 
 int aesd_open(struct inode *inode, struct file *filp)
 {
     struct aesd_dev *dev;
+    struct aesd_file *file;
+    u64 start_ns = ktime_get_ns();
+    u64 lock_wait_ns = 0;
+    int retval = 0;
 
     PDEBUG("open");
     /**
      * TODO: handle open
      */
     dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
-    filp->private_data = dev;
+    file = kzalloc(sizeof(struct aesd_file), GFP_KERNEL);
+    if (file == NULL) {
+        retval = -ENOMEM;
+        goto exit;
+    }
+    file->dev = dev;
+    mutex_init(&file->pending_mutex);
 
-    return 0;
+    if (aesd_lock_interruptible(&dev->circular_buffer_mutex, &lock_wait_ns)) {
+        kfree(file);
+        retval = -ERESTARTSYS;
+        goto exit;
+    }
+    file->evicted_bytes = dev->evicted_bytes;
+    mutex_unlock(&dev->circular_buffer_mutex);
+
+    filp->private_data = file;
+
+exit:
+    trace_aesd_open(MINOR(dev->cdev.dev), retval);
+    aesd_op_record(dev, AESD_OP_OPEN, start_ns, retval, 0, lock_wait_ns);
+    return retval;
 }
 
 int aesd_release(struct inode *inode, struct file *filp)
 {
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    char *carry_buf;
+
     PDEBUG("release");
     /**
      * TODO: handle release
      */
+    if (file->pending.buffptr != NULL) {
+        // Hand an unterminated write to the next writer, as if all writers shared one stream
+        mutex_lock(&dev->circular_buffer_mutex);
+        carry_buf = krealloc(dev->cached_entry.buffptr, dev->cached_entry.size + file->pending.size, GFP_KERNEL);
+        if (carry_buf != NULL) {
+            memcpy(&carry_buf[dev->cached_entry.size], file->pending.buffptr, file->pending.size);
+            dev->cached_entry.buffptr = carry_buf;
+            dev->cached_entry.size += file->pending.size;
+        }
+        else {
+            PDEBUG("WARNING: dropping %zu byte partial write on release", file->pending.size);
+        }
+        mutex_unlock(&dev->circular_buffer_mutex);
+        kfree(file->pending.buffptr);
+    }
+    aesd_compress_tfm_free(file->compress_tfm);
+    mutex_destroy(&file->pending_mutex);
+    kfree(file);
     filp->private_data = NULL;
     return 0;
 }
 
-ssize_t aesd_read(struct file *filp, char __user *buf, size_t count,
-                loff_t *f_pos)
+/**
+ * Translate @param pos, recorded when @param file last looked at the ring, to the current ring
+ * by removing any bytes evicted since.  Caller must hold circular_buffer_mutex.
+ * @return the adjusted position, clamped at the start of the ring
+ */
+static loff_t aesd_file_ring_pos(const struct aesd_file *file, loff_t pos)
+{
+    uint64_t evicted = file->dev->evicted_bytes - file->evicted_bytes;
+
+    return ((uint64_t)pos > evicted) ? (loff_t)(pos - evicted) : 0;
+}
+
+/**
+ * Synchronize filp->f_pos style @param pos with the current ring.  Caller must hold
+ * circular_buffer_mutex.
+ */
+static void aesd_file_sync_pos(struct aesd_file *file, loff_t *pos)
+{
+    *pos = aesd_file_ring_pos(file, *pos);
+    file->evicted_bytes = file->dev->evicted_bytes;
+}
+
+/**
+ * Storage of a compressed record, referenced by the buffptr of its ring entry.  Compressed records
+ * are never mapped to userspace, so unlike plain records they live in kvmalloc'd memory.
+ */
+struct aesd_compressed_buf {
+    size_t compressed_size;
+    char data[];
+};
+
+static bool aesd_entry_is_compressed(struct aesd_dev *dev, const struct aesd_buffer_entry *entry)
+{
+    return test_bit(entry - dev->circular_buffer.entry, dev->compressed_slots);
+}
+
+/**
+ * @return the record stored in @param entry of the ring of @param dev, decompressing it if needed,
+ * or an ERR_PTR.  Caller must hold circular_buffer_mutex, decompressed data is only valid until
+ * it is released.
+ */
+static const char *aesd_entry_data(struct aesd_dev *dev, const struct aesd_buffer_entry *entry)
+{
+    const struct aesd_compressed_buf *compressed;
+    unsigned int size;
+    char *buf;
+
+    if (!aesd_entry_is_compressed(dev, entry)) {
+        return entry->buffptr;
+    }
+    if (dev->decompressed_valid && (dev->decompressed_stream_offs == entry->stream_offs)) {
+        return dev->decompressed_buf;
+    }
+
+    if (dev->decompress_tfm == NULL) {
+        dev->decompress_tfm = aesd_compress_tfm_alloc();
+        if (dev->decompress_tfm == NULL) {
+            return ERR_PTR(-ENOMEM);
+        }
+    }
+    if (dev->decompressed_buf_size < entry->size) {
+        buf = kvmalloc(entry->size, GFP_KERNEL);
+        if (buf == NULL) {
+            return ERR_PTR(-ENOMEM);
+        }
+        kvfree(dev->decompressed_buf);
+        dev->decompressed_buf = buf;
+        dev->decompressed_buf_size = entry->size;
+    }
+    compressed = (const struct aesd_compressed_buf *)entry->buffptr;
+    dev->decompressed_valid = false;
+    size = entry->size;
+    if (crypto_comp_decompress(dev->decompress_tfm, (const u8 *)compressed->data, compressed->compressed_size,
+                (u8 *)dev->decompressed_buf, &size) || (size != entry->size)) {
+        printk(KERN_ERR "aesdchar: failed to decompress record at stream offset %llu\n", entry->stream_offs);
+        return ERR_PTR(-EIO);
+    }
+    dev->decompressed_stream_offs = entry->stream_offs;
+    dev->decompressed_valid = true;
+    return dev->decompressed_buf;
+}
+
+static ssize_t aesd_do_read(struct file *filp, char __user *buf, size_t count,
+                loff_t *f_pos, u64 *lock_wait_ns)
 {
     ssize_t retval = 0;
     /**
      * TODO: handle read
      */
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
     size_t entry_offset;
     struct aesd_buffer_entry *entry;
+    uint64_t commit_count;
 
     PDEBUG("read %zu bytes with offset %lld",count,*f_pos);
 
-    if (mutex_lock_interruptible(&dev->circular_buffer_mutex)) {
-        retval = -ERESTARTSYS;
-        goto exit;
+    if (aesd_lock_interruptible(&dev->circular_buffer_mutex, lock_wait_ns)) {
+        return -ERESTARTSYS;
     }
+    aesd_file_sync_pos(file, f_pos);
     entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->circular_buffer, *f_pos, &entry_offset);
-    if (entry == NULL) {
-        retval = 0; // End of file reached, return 0
-        goto exit;
+    while (entry == NULL) {
+        if (!aesd_blocking_read) {
+            retval = 0; // End of file reached, return 0
+            goto exit;
+        }
+        if (filp->f_flags & O_NONBLOCK) {
+            retval = -EAGAIN;
+            goto exit;
+        }
+
+        commit_count = dev->commit_count;
+        mutex_unlock(&dev->circular_buffer_mutex);
+        if (wait_event_interruptible(dev->read_queue, READ_ONCE(dev->commit_count) != commit_count)) {
+            return -ERESTARTSYS;
+        }
+        if (aesd_lock_interruptible(&dev->circular_buffer_mutex, lock_wait_ns)) {
+            return -ERESTARTSYS;
+        }
+        aesd_file_sync_pos(file, f_pos);
+        entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->circular_buffer, *f_pos, &entry_offset);
     }
 
     if (entry != NULL) {
         size_t available_bytes = entry->size - entry_offset;
         size_t bytes_to_read = count > available_bytes ? available_bytes : count;
+        const char *data = aesd_entry_data(dev, entry);
 
-        if (copy_to_user(buf, entry->buffptr + entry_offset, bytes_to_read)) {
+        if (IS_ERR(data)) {
+            retval = PTR_ERR(data);
+        } else if (copy_to_user(buf, data + entry_offset, bytes_to_read)) {
             retval = -EFAULT; // Error while copying data to user space
             PDEBUG("ERROR: copy_to_user failed!");
         } else {
@@ -100,131 +350,534 @@ exit:
     return retval;
 }
 
-ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count,
+ssize_t aesd_read(struct file *filp, char __user *buf, size_t count,
                 loff_t *f_pos)
+{
+    struct aesd_file *file = filp->private_data;
+    u64 start_ns = ktime_get_ns();
+    u64 lock_wait_ns = 0;
+    loff_t pos = *f_pos;
+    ssize_t retval;
+
+    retval = aesd_do_read(filp, buf, count, f_pos, &lock_wait_ns);
+    trace_aesd_read(MINOR(file->dev->cdev.dev), count, pos, retval, lock_wait_ns);
+    aesd_op_record(file->dev, AESD_OP_READ, start_ns, retval, (retval > 0) ? retval : 0, lock_wait_ns);
+    return retval;
+}
+
+/**
+ * Entry storage is page backed rather than kmalloc'd so it can be handed to userspace
+ * through aesd_mmap.  aesd_vm_fault maps the last page whole, so the bytes past @param size
+ * are zeroed here rather than left holding whatever the page held before.
+ */
+static char *aesd_entry_buf_alloc(size_t size)
+{
+    char *buffptr = alloc_pages_exact(size, GFP_KERNEL);
+
+    if (buffptr != NULL) {
+        memset(buffptr + size, 0, PAGE_ALIGN(size) - size);
+    }
+    return buffptr;
+}
+
+static void aesd_entry_buf_free(const char *buffptr, size_t size)
+{
+    if (buffptr != NULL) {
+        free_pages_exact((void *)buffptr, size);
+    }
+}
+
+/**
+ * Release the storage of a record of @param size bytes at @param buffptr, which was stored
+ * compressed if @param compressed is set.
+ */
+static void aesd_entry_storage_free(const char *buffptr, size_t size, bool compressed)
+{
+    if (compressed) {
+        kvfree(buffptr);
+    }
+    else {
+        aesd_entry_buf_free(buffptr, size);
+    }
+}
+
+/**
+ * Refresh the header page shared with userspace.  Caller must hold circular_buffer_mutex.
+ */
+static void aesd_mmap_update_header(struct aesd_dev *dev)
+{
+    struct aesd_mmap_header *header = dev->mmap_header;
+    struct aesd_buffer_entry *entry;
+    uint32_t entry_count = 0;
+    uint64_t total_size = 0;
+    uint8_t index;
+
+    WRITE_ONCE(header->generation, header->generation + 1);
+    smp_wmb();
+    AESD_CIRCULAR_BUFFER_FOREACH(entry, &dev->circular_buffer, index) {
+        header->slot[index].size = entry->size;
+        if (aesd_buffer_entry_is_inline(entry)) {
+            memcpy(header->slot[index].inline_data, entry->inline_data, entry->size);
+            header->slot[index].data_offset = (char *)header->slot[index].inline_data - (char *)header;
+        }
+        else if (test_bit(index, dev->compressed_slots)) {
+            header->slot[index].data_offset = 0;
+        }
+        else {
+            header->slot[index].data_offset = (uint64_t)(index + 1) * AESD_MMAP_SLOT_SIZE;
+        }
+        if (entry->buffptr != NULL) {
+            entry_count++;
+            total_size += entry->size;
+        }
+    }
+    header->entry_count = entry_count;
+    header->total_size = total_size;
+    header->in_offs = dev->circular_buffer.in_offs;
+    header->out_offs = dev->circular_buffer.out_offs;
+    header->full = dev->circular_buffer.full;
+    header->out_seq = dev->circular_buffer.out_seq;
+    smp_wmb();
+    WRITE_ONCE(header->generation, header->generation + 1);
+}
+
+/**
+ * Add @param new_entry to the ring, releasing the entry it replaces and zapping any userspace
+ * mapping of the reused slot.  @param compressed tells whether aesd_entry_init stored the entry
+ * compressed.  Caller must hold circular_buffer_mutex.
+ */
+static void aesd_commit_entry(struct aesd_dev *dev, const struct aesd_buffer_entry *new_entry, bool compressed)
+{
+    const char *replaced_buffer;
+    size_t replaced_size = 0;
+    uint8_t slot = dev->circular_buffer.in_offs;
+    bool replaced_compressed = test_bit(slot, dev->compressed_slots);
+
+    mutex_lock(&dev->mmap_mutex);
+    if (dev->circular_buffer.full) {
+        replaced_size = dev->circular_buffer.entry[slot].size;
+    }
+    // NULL for an inline entry, which has nothing to free
+    replaced_buffer = aesd_circular_buffer_add_entry(&dev->circular_buffer, new_entry);
+    assign_bit(slot, dev->compressed_slots, compressed);
+    if (dev->mmap_inode != NULL) {
+        unmap_mapping_range(dev->mmap_inode->i_mapping, (loff_t)(slot + 1) * AESD_MMAP_SLOT_SIZE,
+                AESD_MMAP_SLOT_SIZE, 1);
+    }
+    mutex_unlock(&dev->mmap_mutex);
+
+    aesd_entry_storage_free(replaced_buffer, replaced_size, replaced_compressed);
+    dev->evicted_bytes += replaced_size;
+    dev->commit_count++;
+    aesd_mmap_update_header(dev);
+
+    wake_up_interruptible(&dev->read_queue);
+}
+
+/**
+ * Try to store the @param size bytes at @param data in @param entry compressed with @param tfm.
+ * @return true if the data was compressed, false if it should be stored as is
+ */
+static bool aesd_entry_compress(struct aesd_dev *dev, struct aesd_buffer_entry *entry, const char *data,
+            size_t size, struct crypto_comp *tfm)
+{
+    struct aesd_compressed_buf *bound_buf;
+    struct aesd_compressed_buf *compressed;
+    unsigned int compressed_size;
+
+    if ((size <= sizeof(struct aesd_compressed_buf) + 1) || (size > UINT_MAX)) {
+        return false;
+    }
+    // Keep incompressible records in plain pages, where they can also be mapped.  The output is
+    // limited to less than the record, so compression fails for any record it wouldn't shrink.
+    bound_buf = kvmalloc(size, GFP_KERNEL);
+    if (bound_buf == NULL) {
+        return false;
+    }
+    compressed_size = size - sizeof(struct aesd_compressed_buf) - 1;
+    if (crypto_comp_compress(tfm, (const u8 *)data, size, (u8 *)bound_buf->data, &compressed_size)) {
+        kvfree(bound_buf);
+        return false;
+    }
+
+    // Don't hold on to the worst case allocation for the life of the record
+    compressed = kvmalloc(sizeof(struct aesd_compressed_buf) + compressed_size, GFP_KERNEL);
+    if (compressed == NULL) {
+        kvfree(bound_buf);
+        return false;
+    }
+    compressed->compressed_size = compressed_size;
+    memcpy(compressed->data, bound_buf->data, compressed_size);
+    kvfree(bound_buf);
+
+    entry->buffptr = (const char *)compressed;
+    entry->size = size;
+    atomic64_inc(&dev->compressed_entries);
+    atomic64_add(size, &dev->compressed_input_bytes);
+    atomic64_add(compressed_size, &dev->compressed_output_bytes);
+    return true;
+}
+
+/**
+ * Fill @param entry with a copy of the @param size bytes at @param data, compressed if
+ * @param compress_tfm is set and the record reaches aesd_compress_threshold.  @param compressed
+ * is set to whether it was, for aesd_commit_entry.
+ * @return 0 on success or -ENOMEM
+ */
+static int aesd_entry_init(struct aesd_dev *dev, struct aesd_buffer_entry *entry, const char *data, size_t size,
+            struct crypto_comp *compress_tfm, bool *compressed)
+{
+    unsigned int threshold = READ_ONCE(aesd_compress_threshold);
+
+    *compressed = false;
+    // Short lines live in the ring entry itself, longer ones get their own pages
+    if (aesd_buffer_entry_set_inline(entry, data, size)) {
+        return 0;
+    }
+    if ((compress_tfm != NULL) && (threshold != 0) && (size >= threshold)) {
+        *compressed = aesd_entry_compress(dev, entry, data, size, compress_tfm);
+        if (*compressed) {
+            return 0;
+        }
+    }
+    entry->buffptr = aesd_entry_buf_alloc(size);
+    if (entry->buffptr == NULL) {
+        return -ENOMEM;
+    }
+    memcpy((char *)entry->buffptr, data, size);
+    entry->size = size;
+    return 0;
+}
+
+static ssize_t aesd_do_write(struct file *filp, const char __user *buf, size_t count,
+                loff_t *f_pos, u64 *lock_wait_ns)
 {
     ssize_t retval = -ENOMEM;
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
 
-    const char *replaced_buffer = NULL;
     char *temp_buf;
-    size_t temp_buf_size = count;
-    size_t temp_buf_write_offset = 0;
+    size_t temp_buf_size;
+    size_t temp_buf_write_offset;
+    size_t line_start = 0;
+    size_t scan_offset;
+    size_t remainder;
+    const char *newline;
+    int result = 0;
+    int batch_count;
+    int i;
 
     size_t bytes_not_copied = 0;
-    struct aesd_buffer_entry new_entry;
+    struct aesd_buffer_entry batch[AESD_WRITE_BATCH];
+    bool batch_compressed[AESD_WRITE_BATCH];
     PDEBUG("write %zu bytes with offset %lld",count,*f_pos);
     /**
      * TODO: handle write
      */
 
-    if (mutex_lock_interruptible(&dev->circular_buffer_mutex)) {
-        retval = -ERESTARTSYS;
-        goto exit;
-    }
-
     if (count == 0) {
-        retval = 0;
-        goto exit; // Nothing to write
+        return 0; // Nothing to write
     }
 
-    if (dev->cached_entry.buffptr != NULL) {
-        temp_buf_write_offset = dev->cached_entry.size;
-        temp_buf = (char *)dev->cached_entry.buffptr;
-        temp_buf_size += temp_buf_write_offset;
+    // Only the per file lock is held while touching user memory, see aesd_dev.mmap_mutex
+    if (aesd_lock_interruptible(&file->pending_mutex, lock_wait_ns)) {
+        return -ERESTARTSYS;
+    }
 
-        temp_buf = krealloc(temp_buf, temp_buf_size, GFP_KERNEL);
+    if ((file->pending.buffptr == NULL) && (READ_ONCE(dev->cached_entry.buffptr) != NULL)) {
+        if (aesd_lock_interruptible(&dev->circular_buffer_mutex, lock_wait_ns)) {
+            retval = -ERESTARTSYS;
+            goto exit;
+        }
+        file->pending = dev->cached_entry;
+        dev->cached_entry.buffptr = NULL;
+        dev->cached_entry.size = 0;
+        mutex_unlock(&dev->circular_buffer_mutex);
     }
-    else {
-        temp_buf = kmalloc(temp_buf_size, GFP_KERNEL); // Allocate memory for the buffer
+
+    if ((file->compress_tfm == NULL) && (READ_ONCE(aesd_compress_threshold) != 0)) {
+        // Compression is best effort, records are stored as is if this fails
+        file->compress_tfm = aesd_compress_tfm_alloc();
     }
+
+    temp_buf_write_offset = file->pending.size;
+    temp_buf_size = temp_buf_write_offset + count;
+    temp_buf = krealloc(file->pending.buffptr, temp_buf_size, GFP_KERNEL);
     if (!temp_buf) {
         retval = -ENOMEM; // Memory allocation failed
-        goto exit; 
+        goto exit;
     }
+    file->pending.buffptr = temp_buf;
 
     bytes_not_copied = copy_from_user(&temp_buf[temp_buf_write_offset], buf, count);
-
-    if (bytes_not_copied == 0) {
-        retval = count;
+    if (bytes_not_copied == count) {
+        retval = -EFAULT;
+        goto exit;
     }
-    else {
-        retval = count - bytes_not_copied;
+    if (bytes_not_copied != 0) {
         temp_buf_size -= bytes_not_copied;
         PDEBUG("WARNING: copy_from_user failed to copy %zu bytes (total expected = %zu bytes).\n", bytes_not_copied, count);
     }
+    retval = count - bytes_not_copied;
 
-    if (memchr(temp_buf, '\n', temp_buf_size) != NULL) {
-        new_entry.buffptr = temp_buf;
-        new_entry.size = temp_buf_size;
-        replaced_buffer = aesd_circular_buffer_add_entry(&dev->circular_buffer, &new_entry);
+    /**
+     * The pending bytes never contain a newline, so only the bytes just copied are scanned.
+     * Every newline terminated line becomes its own entry; entries are prepared without the
+     * ring lock and committed in batches.
+     */
+    scan_offset = temp_buf_write_offset;
+    do {
+        batch_count = 0;
+        while ((batch_count < AESD_WRITE_BATCH) &&
+               (newline = memchr(&temp_buf[scan_offset], '\n', temp_buf_size - scan_offset)) != NULL) {
+            scan_offset = newline - temp_buf + 1;
+            result = aesd_entry_init(dev, &batch[batch_count], &temp_buf[line_start], scan_offset - line_start,
+                        file->compress_tfm, &batch_compressed[batch_count]);
+            if (result) {
+                break;
+            }
+            line_start = scan_offset;
+            batch_count++;
+        }
 
-        if (replaced_buffer != NULL)
-        {
-            kfree(replaced_buffer);
+        if (batch_count > 0) {
+            // Not interruptible, the lines in batch are already consumed from temp_buf
+            aesd_lock(&dev->circular_buffer_mutex, lock_wait_ns);
+            for (i = 0; i < batch_count; i++) {
+                aesd_commit_entry(dev, &batch[i], batch_compressed[i]);
+            }
+            mutex_unlock(&dev->circular_buffer_mutex);
         }
+    } while ((batch_count == AESD_WRITE_BATCH) && (result == 0));
 
-        dev->cached_entry.buffptr = NULL;
-        dev->cached_entry.size= 0;
+    if (result) {
+        if (line_start == 0) {
+            // Nothing from this write was committed, drop the new bytes and report the failure
+            file->pending.size = temp_buf_write_offset;
+            retval = result;
+            goto exit;
+        }
+        // Report the bytes committed so far, the caller retries the rest
+        retval = line_start - temp_buf_write_offset;
+        temp_buf_size = line_start;
     }
-    else {
-        dev->cached_entry.buffptr = temp_buf;
-        dev->cached_entry.size = temp_buf_size;
+
+    remainder = temp_buf_size - line_start;
+    if (remainder == 0) {
+        kfree(temp_buf);
+        file->pending.buffptr = NULL;
+    }
+    else if (line_start != 0) {
+        memmove(temp_buf, &temp_buf[line_start], remainder);
     }
+    file->pending.size = remainder;
 
 exit:
-    mutex_unlock(&dev->circular_buffer_mutex);
+    mutex_unlock(&file->pending_mutex);
+    return retval;
+}
+
+ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count,
+                loff_t *f_pos)
+{
+    struct aesd_file *file = filp->private_data;
+    u64 start_ns = ktime_get_ns();
+    u64 lock_wait_ns = 0;
+    loff_t pos = *f_pos;
+    ssize_t retval;
+
+    retval = aesd_do_write(filp, buf, count, f_pos, &lock_wait_ns);
+    trace_aesd_write(MINOR(file->dev->cdev.dev), count, pos, retval, lock_wait_ns);
+    aesd_op_record(file->dev, AESD_OP_WRITE, start_ns, retval, (retval > 0) ? retval : 0, lock_wait_ns);
     return retval;
 }
 
 loff_t aesd_llseek(struct file *filp, loff_t off, int whence)
 {
     loff_t retval, total_entries_size;
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    u64 start_ns = ktime_get_ns();
+    u64 lock_wait_ns = 0;
 
-    if (mutex_lock_interruptible(&dev->circular_buffer_mutex)) {
+    if (aesd_lock_interruptible(&dev->circular_buffer_mutex, &lock_wait_ns)) {
         retval = -ERESTARTSYS;
         goto exit;
     }
+    aesd_file_sync_pos(file, &filp->f_pos);
     total_entries_size =  aesd_circular_buffer_entries_total_size(&dev->circular_buffer);
-    mutex_unlock(&dev->circular_buffer_mutex);
 
     // Use fixed_size_llseek to handle the seek operation
     retval = fixed_size_llseek(filp, off, whence, total_entries_size);
+    mutex_unlock(&dev->circular_buffer_mutex);
 
 exit:
+    trace_aesd_llseek(MINOR(dev->cdev.dev), off, whence, retval, lock_wait_ns);
+    aesd_op_record(dev, AESD_OP_LLSEEK, start_ns, retval, 0, lock_wait_ns);
     return retval;
 }
 
-static long aesd_adjust_file_offset(struct file *filp, unsigned int write_cmd, unsigned int write_cmd_offset)
+static long aesd_adjust_file_offset(struct file *filp, unsigned int write_cmd, unsigned int write_cmd_offset,
+            u64 *lock_wait_ns)
 {
     long retval = 0;
-    struct aesd_dev *dev = filp->private_data;
-    long buffer_start_offset = 0;
-    int i;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    struct aesd_buffer_entry *entry;
+    size_t buffer_start_offset;
 
-    if (mutex_lock_interruptible(&dev->circular_buffer_mutex)) {
-        retval = -ERESTARTSYS;
-        goto exit;
+    if (aesd_lock_interruptible(&dev->circular_buffer_mutex, lock_wait_ns)) {
+        return -ERESTARTSYS;
     }
-    if ((write_cmd >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) || 
-        (dev->circular_buffer.entry[write_cmd].size == 0) || 
-        (write_cmd_offset >= dev->circular_buffer.entry[write_cmd].size)) {
+    // write_cmd counts from the oldest entry, which is only slot 0 until the ring wraps
+    entry = aesd_circular_buffer_find_entry_for_seq(&dev->circular_buffer,
+                dev->circular_buffer.out_seq + write_cmd, &buffer_start_offset);
+    if ((entry == NULL) || (write_cmd_offset >= entry->size)) {
         retval = -EINVAL;
         goto exit;
     }
 
-    for (i = 0; i < write_cmd; i++) {
-        buffer_start_offset += dev->circular_buffer.entry[i].size;
-    }
     filp->f_pos = buffer_start_offset + write_cmd_offset;
+    file->evicted_bytes = dev->evicted_bytes;
 
 exit:
     mutex_unlock(&dev->circular_buffer_mutex);
     return retval;
 }
 
-long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+static long aesd_seek_seq(struct file *filp, struct aesd_seekseq __user *user_seek, u64 *lock_wait_ns)
+{
+    long retval = 0;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    struct aesd_circular_buffer *buffer = &dev->circular_buffer;
+    struct aesd_seekseq seek_params;
+    struct aesd_buffer_entry *entry;
+    uint64_t next_seq;
+    size_t buffer_start_offset;
+
+    if (copy_from_user(&seek_params, user_seek, sizeof(seek_params))) {
+        return -EFAULT;
+    }
+
+    if (aesd_lock_interruptible(&dev->circular_buffer_mutex, lock_wait_ns)) {
+        return -ERESTARTSYS;
+    }
+    next_seq = buffer->out_seq + aesd_circular_buffer_entry_count(buffer);
+    if (seek_params.seq < buffer->out_seq) {
+        // Already evicted, resume from the oldest command still available
+        seek_params.seq = buffer->out_seq;
+        seek_params.seq_offset = 0;
+    }
+
+    if (seek_params.seq == next_seq) {
+        if (seek_params.seq_offset != 0) {
+            retval = -EINVAL;
+            goto exit;
+        }
+        filp->f_pos = aesd_circular_buffer_entries_total_size(buffer);
+    }
+    else {
+        entry = aesd_circular_buffer_find_entry_for_seq(buffer, seek_params.seq, &buffer_start_offset);
+        if ((entry == NULL) || (seek_params.seq_offset >= entry->size)) {
+            retval = -EINVAL;
+            goto exit;
+        }
+        filp->f_pos = buffer_start_offset + seek_params.seq_offset;
+    }
+    file->evicted_bytes = dev->evicted_bytes;
+
+exit:
+    mutex_unlock(&dev->circular_buffer_mutex);
+    if ((retval == 0) && copy_to_user(user_seek, &seek_params, sizeof(seek_params))) {
+        retval = -EFAULT;
+    }
+    return retval;
+}
+
+static long aesd_get_records(struct file *filp, struct aesd_records_request __user *user_request,
+            u64 *lock_wait_ns)
+{
+    long retval = 0;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    struct aesd_records_request request;
+    struct aesd_record_iovec iov[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    struct aesd_buffer_entry *entry;
+    const char *data;
+    uint32_t count;
+    uint32_t i;
+
+    if (copy_from_user(&request, user_request, sizeof(request))) {
+        return -EFAULT;
+    }
+    // The ring never holds more records than this, ignore any extra iovecs
+    count = min_t(uint32_t, request.count, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+    if (copy_from_user(iov, u64_to_user_ptr(request.iov), count * sizeof(iov[0]))) {
+        return -EFAULT;
+    }
+
+    if (aesd_lock_interruptible(&dev->circular_buffer_mutex, lock_wait_ns)) {
+        return -ERESTARTSYS;
+    }
+    for (i = 0; i < count; i++) {
+        entry = aesd_circular_buffer_get_entry(&dev->circular_buffer, (size_t)request.first_cmd + i);
+        if (entry == NULL) {
+            break;
+        }
+        data = aesd_entry_data(dev, entry);
+        if (IS_ERR(data)) {
+            retval = PTR_ERR(data);
+            break;
+        }
+        iov[i].size = entry->size;
+        if (copy_to_user(u64_to_user_ptr(iov[i].base), data, min_t(uint64_t, iov[i].len, entry->size))) {
+            retval = -EFAULT;
+            break;
+        }
+    }
+    mutex_unlock(&dev->circular_buffer_mutex);
+    request.returned = i;
+
+    if (retval == 0) {
+        if (copy_to_user(u64_to_user_ptr(request.iov), iov, request.returned * sizeof(iov[0])) ||
+            copy_to_user(user_request, &request, sizeof(request))) {
+            retval = -EFAULT;
+        }
+    }
+    return retval;
+}
+
+static long aesd_get_stats(struct file *filp, struct aesd_stats __user *user_stats, u64 *lock_wait_ns)
+{
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    struct aesd_stats stats;
+    struct aesd_buffer_entry *entry;
+    uint32_t i;
+
+    memset(&stats, 0, sizeof(stats));
+    stats.max_entries = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+
+    if (aesd_lock_interruptible(&dev->circular_buffer_mutex, lock_wait_ns)) {
+        return -ERESTARTSYS;
+    }
+    stats.entry_count = aesd_circular_buffer_entry_count(&dev->circular_buffer);
+    stats.first_seq = dev->circular_buffer.out_seq;
+    for (i = 0; i < stats.entry_count; i++) {
+        entry = aesd_circular_buffer_get_entry(&dev->circular_buffer, i);
+        stats.entry_size[i] = entry->size;
+        stats.total_bytes += entry->size;
+    }
+    mutex_unlock(&dev->circular_buffer_mutex);
+
+    if (copy_to_user(user_stats, &stats, sizeof(stats))) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+static long aesd_do_ioctl(struct file *filp, unsigned int cmd, unsigned long arg, u64 *lock_wait_ns)
 {
     long retval = -ENOTTY;
     struct aesd_seekto seek_params;
@@ -239,10 +892,23 @@ long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
             retval = -EFAULT;
         }
         else {
-            retval = aesd_adjust_file_offset(filp, seek_params.write_cmd, seek_params.write_cmd_offset);
+            retval = aesd_adjust_file_offset(filp, seek_params.write_cmd, seek_params.write_cmd_offset,
+                        lock_wait_ns);
         }
         break;
 
+    case AESDCHAR_IOCGETRECORDS:
+        retval = aesd_get_records(filp, (struct aesd_records_request __user *)arg, lock_wait_ns);
+        break;
+
+    case AESDCHAR_IOCGETSTATS:
+        retval = aesd_get_stats(filp, (struct aesd_stats __user *)arg, lock_wait_ns);
+        break;
+
+    case AESDCHAR_IOCSEEKSEQ:
+        retval = aesd_seek_seq(filp, (struct aesd_seekseq __user *)arg, lock_wait_ns);
+        break;
+
     default:
         break;
     }
@@ -251,6 +917,362 @@ exit:
     return retval;
 }
 
+long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct aesd_file *file = filp->private_data;
+    u64 start_ns = ktime_get_ns();
+    u64 lock_wait_ns = 0;
+    long retval;
+
+    retval = aesd_do_ioctl(filp, cmd, arg, &lock_wait_ns);
+    trace_aesd_ioctl(MINOR(file->dev->cdev.dev), cmd, retval, lock_wait_ns);
+    aesd_op_record(file->dev, AESD_OP_IOCTL, start_ns, retval, 0, lock_wait_ns);
+    return retval;
+}
+
+__poll_t aesd_poll(struct file *filp, poll_table *wait)
+{
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(filp, &dev->read_queue, wait);
+
+    mutex_lock(&dev->circular_buffer_mutex);
+    if (aesd_circular_buffer_find_entry_offset_for_fpos(&dev->circular_buffer,
+                aesd_file_ring_pos(file, filp->f_pos), NULL) != NULL) {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+    mutex_unlock(&dev->circular_buffer_mutex);
+
+    return mask;
+}
+
+static vm_fault_t aesd_vm_fault(struct vm_fault *vmf)
+{
+    struct vm_area_struct *vma = vmf->vma;
+    struct aesd_dev *dev = vma->vm_private_data;
+    unsigned long offset = vmf->pgoff << PAGE_SHIFT;
+    struct page *page = NULL;
+    int err;
+
+    mutex_lock(&dev->mmap_mutex);
+    if (offset < PAGE_SIZE) {
+        page = virt_to_page(dev->mmap_header);
+    }
+    else if (offset >= AESD_MMAP_SLOT_SIZE) {
+        unsigned long slot = offset / AESD_MMAP_SLOT_SIZE - 1;
+        unsigned long slot_offset = offset % AESD_MMAP_SLOT_SIZE;
+
+        if (slot < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+            struct aesd_buffer_entry *entry = &dev->circular_buffer.entry[slot];
+
+            // Inline entries are read from the header page and compressed ones aren't mapped,
+            // see aesd_mmap_update_header
+            if ((entry->buffptr != NULL) && !aesd_buffer_entry_is_inline(entry) &&
+                !test_bit(slot, dev->compressed_slots) && (slot_offset < entry->size)) {
+                page = virt_to_page(entry->buffptr + slot_offset);
+            }
+        }
+    }
+
+    if (page == NULL) {
+        mutex_unlock(&dev->mmap_mutex);
+        return VM_FAULT_SIGBUS;
+    }
+    // Insert while holding mmap_mutex so a concurrent aesd_commit_entry can't leave a stale pte
+    err = vm_insert_page(vma, vmf->address, page);
+    mutex_unlock(&dev->mmap_mutex);
+
+    if (err && err != -EBUSY) {
+        return vmf_error(err);
+    }
+    return VM_FAULT_NOPAGE;
+}
+
+static const struct vm_operations_struct aesd_vm_ops = {
+    .fault = aesd_vm_fault,
+};
+
+int aesd_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    struct inode *inode = file_inode(filp);
+    int retval = 0;
+
+    PDEBUG("mmap %lu bytes at page offset %lu", vma->vm_end - vma->vm_start, vma->vm_pgoff);
+
+    if (vma->vm_flags & VM_WRITE) {
+        return -EPERM;
+    }
+    if (vma->vm_pgoff + vma_pages(vma) > (AESD_MMAP_LENGTH >> PAGE_SHIFT)) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&dev->mmap_mutex);
+    if (dev->mmap_inode == NULL) {
+        ihold(inode);
+        dev->mmap_inode = inode;
+    }
+    else if (dev->mmap_inode != inode) {
+        // Stale slots are zapped through a single address_space, see aesd_commit_entry
+        retval = -EBUSY;
+    }
+    mutex_unlock(&dev->mmap_mutex);
+    if (retval) {
+        return retval;
+    }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_mod(vma, VM_MIXEDMAP | VM_DONTEXPAND | VM_DONTDUMP, VM_MAYWRITE);
+#else
+    vma->vm_flags |= VM_MIXEDMAP | VM_DONTEXPAND | VM_DONTDUMP;
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+    vma->vm_ops = &aesd_vm_ops;
+    vma->vm_private_data = dev;
+    return 0;
+}
+
+/**
+ * Snapshot image built when the debugfs snapshot file is opened, so every read of one open file
+ * sees the same consistent copy of the ring
+ */
+struct aesd_snapshot_image {
+    size_t size;
+    char data[];
+};
+
+static int aesd_snapshot_open(struct inode *inode, struct file *filp)
+{
+    struct aesd_dev *dev = inode->i_private;
+    struct aesd_snapshot_image *image;
+    struct aesd_snapshot_header *header;
+    struct aesd_snapshot_record *record;
+    struct aesd_buffer_entry *entry;
+    const char *data;
+    size_t size = sizeof(struct aesd_snapshot_header);
+    size_t offset;
+    uint32_t entry_count;
+    uint32_t i;
+
+    if (mutex_lock_interruptible(&dev->circular_buffer_mutex)) {
+        return -ERESTARTSYS;
+    }
+    entry_count = aesd_circular_buffer_entry_count(&dev->circular_buffer);
+    for (i = 0; i < entry_count; i++) {
+        entry = aesd_circular_buffer_get_entry(&dev->circular_buffer, i);
+        size += sizeof(struct aesd_snapshot_record) + ALIGN(entry->size, AESD_SNAPSHOT_ALIGN);
+    }
+
+    image = kvzalloc(sizeof(struct aesd_snapshot_image) + size, GFP_KERNEL);
+    if (image == NULL) {
+        mutex_unlock(&dev->circular_buffer_mutex);
+        return -ENOMEM;
+    }
+    image->size = size;
+
+    header = (struct aesd_snapshot_header *)image->data;
+    header->magic = AESD_SNAPSHOT_MAGIC;
+    header->version = AESD_SNAPSHOT_VERSION;
+    header->entry_count = entry_count;
+    header->first_seq = dev->circular_buffer.out_seq;
+    header->first_stream_offs = dev->circular_buffer.stream_size -
+            aesd_circular_buffer_entries_total_size(&dev->circular_buffer);
+
+    offset = sizeof(struct aesd_snapshot_header);
+    for (i = 0; i < entry_count; i++) {
+        entry = aesd_circular_buffer_get_entry(&dev->circular_buffer, i);
+        data = aesd_entry_data(dev, entry);
+        if (IS_ERR(data)) {
+            mutex_unlock(&dev->circular_buffer_mutex);
+            kvfree(image);
+            return PTR_ERR(data);
+        }
+        record = (struct aesd_snapshot_record *)&image->data[offset];
+        record->size = entry->size;
+        offset += sizeof(struct aesd_snapshot_record);
+        memcpy(&image->data[offset], data, entry->size);
+        offset += ALIGN(entry->size, AESD_SNAPSHOT_ALIGN);
+    }
+    mutex_unlock(&dev->circular_buffer_mutex);
+
+    filp->private_data = image;
+    return 0;
+}
+
+static ssize_t aesd_snapshot_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
+{
+    struct aesd_snapshot_image *image = filp->private_data;
+
+    return simple_read_from_buffer(buf, count, f_pos, image->data, image->size);
+}
+
+static int aesd_snapshot_release(struct inode *inode, struct file *filp)
+{
+    kvfree(filp->private_data);
+    return 0;
+}
+
+static const struct file_operations aesd_snapshot_fops = {
+    .owner =    THIS_MODULE,
+    .open =     aesd_snapshot_open,
+    .read =     aesd_snapshot_read,
+    .release =  aesd_snapshot_release,
+    .llseek =   default_llseek,
+};
+
+/**
+ * Parse state of an image written to the debugfs restore file.  The image may arrive in any
+ * number of writes; each complete record is committed as soon as it has been received.
+ */
+struct aesd_restore_state {
+    struct aesd_dev *dev;
+    char *buf;
+    size_t len;
+    bool header_done;
+    uint32_t records_remaining;
+    struct crypto_comp *compress_tfm;
+};
+
+static int aesd_restore_open(struct inode *inode, struct file *filp)
+{
+    struct aesd_restore_state *state;
+
+    state = kzalloc(sizeof(struct aesd_restore_state), GFP_KERNEL);
+    if (state == NULL) {
+        return -ENOMEM;
+    }
+    state->dev = inode->i_private;
+    if (READ_ONCE(aesd_compress_threshold) != 0) {
+        state->compress_tfm = aesd_compress_tfm_alloc();
+    }
+    filp->private_data = state;
+    return 0;
+}
+
+/**
+ * Consume the header and any complete records at the start of state->buf.
+ * @return 0, or a negative error if the image is invalid or can't be restored
+ */
+static int aesd_restore_parse(struct aesd_restore_state *state)
+{
+    struct aesd_dev *dev = state->dev;
+    const struct aesd_snapshot_header *header;
+    const struct aesd_snapshot_record *record;
+    struct aesd_buffer_entry entry;
+    bool compressed;
+    size_t consumed = 0;
+    size_t record_len;
+    int result = 0;
+
+    mutex_lock(&dev->circular_buffer_mutex);
+    if (!state->header_done && (state->len >= sizeof(struct aesd_snapshot_header))) {
+        header = (const struct aesd_snapshot_header *)state->buf;
+        if ((header->magic != AESD_SNAPSHOT_MAGIC) || (header->version != AESD_SNAPSHOT_VERSION)) {
+            result = -EINVAL;
+            goto exit;
+        }
+        // Only a freshly loaded device can take over the sequence numbers of the image
+        if ((dev->circular_buffer.stream_size != 0) || (dev->circular_buffer.out_seq != 0)) {
+            result = -EBUSY;
+            goto exit;
+        }
+        dev->circular_buffer.out_seq = header->first_seq;
+        dev->circular_buffer.stream_size = header->first_stream_offs;
+        dev->evicted_bytes = header->first_stream_offs;
+        state->records_remaining = header->entry_count;
+        state->header_done = true;
+        consumed = sizeof(struct aesd_snapshot_header);
+    }
+
+    while (state->header_done && (state->records_remaining > 0) &&
+           (state->len - consumed >= sizeof(struct aesd_snapshot_record))) {
+        record = (const struct aesd_snapshot_record *)&state->buf[consumed];
+        if ((record->size == 0) || (record->size > SIZE_MAX - sizeof(struct aesd_snapshot_record) - AESD_SNAPSHOT_ALIGN)) {
+            result = -EINVAL;
+            goto exit;
+        }
+        record_len = sizeof(struct aesd_snapshot_record) + ALIGN(record->size, AESD_SNAPSHOT_ALIGN);
+        if (state->len - consumed < record_len) {
+            break; // Wait for the rest of the record
+        }
+        result = aesd_entry_init(dev, &entry, &state->buf[consumed + sizeof(struct aesd_snapshot_record)],
+                    record->size, state->compress_tfm, &compressed);
+        if (result) {
+            goto exit;
+        }
+        aesd_commit_entry(dev, &entry, compressed);
+        consumed += record_len;
+        state->records_remaining--;
+    }
+
+exit:
+    mutex_unlock(&dev->circular_buffer_mutex);
+    if (consumed != 0) {
+        memmove(state->buf, &state->buf[consumed], state->len - consumed);
+        state->len -= consumed;
+    }
+    return result;
+}
+
+static ssize_t aesd_restore_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos)
+{
+    struct aesd_restore_state *state = filp->private_data;
+    char *new_buf;
+    int result;
+
+    if (count == 0) {
+        return 0;
+    }
+    if (state->header_done && (state->records_remaining == 0)) {
+        return -ENOSPC; // Trailing data after the last record
+    }
+    // kvrealloc changed signature in 6.12, copy by hand instead
+    new_buf = kvmalloc(state->len + count, GFP_KERNEL);
+    if (new_buf == NULL) {
+        return -ENOMEM;
+    }
+    if (state->len != 0) {
+        memcpy(new_buf, state->buf, state->len);
+    }
+    kvfree(state->buf);
+    state->buf = new_buf;
+    if (copy_from_user(&state->buf[state->len], buf, count)) {
+        return -EFAULT;
+    }
+    state->len += count;
+
+    result = aesd_restore_parse(state);
+    if (result) {
+        return result;
+    }
+    *f_pos += count;
+    return count;
+}
+
+static int aesd_restore_release(struct inode *inode, struct file *filp)
+{
+    struct aesd_restore_state *state = filp->private_data;
+
+    if (state->len != 0 || (state->header_done && state->records_remaining != 0)) {
+        printk(KERN_WARNING "aesdchar: restore image truncated, %u records missing\n",
+                state->records_remaining);
+    }
+    kvfree(state->buf);
+    aesd_compress_tfm_free(state->compress_tfm);
+    kfree(state);
+    return 0;
+}
+
+static const struct file_operations aesd_restore_fops = {
+    .owner =    THIS_MODULE,
+    .open =     aesd_restore_open,
+    .write =    aesd_restore_write,
+    .release =  aesd_restore_release,
+};
+
 struct file_operations aesd_fops = {
     .owner =    THIS_MODULE,
     .read =     aesd_read,
@@ -259,74 +1281,221 @@ struct file_operations aesd_fops = {
     .release =  aesd_release,
     .llseek =   aesd_llseek,
     .unlocked_ioctl = aesd_unlocked_ioctl,
+    .mmap =     aesd_mmap,
+    .poll =     aesd_poll,
 };
 
-static int aesd_setup_cdev(struct aesd_dev *dev)
+static int aesd_setup_cdev(struct aesd_dev *dev, int index)
 {
-    int err, devno = MKDEV(aesd_major, aesd_minor);
+    int err, devno = MKDEV(aesd_major, aesd_minor + index);
 
     cdev_init(&dev->cdev, &aesd_fops);
     dev->cdev.owner = THIS_MODULE;
     dev->cdev.ops = &aesd_fops;
     err = cdev_add (&dev->cdev, devno, 1);
     if (err) {
-        printk(KERN_ERR "Error %d adding aesd cdev", err);
+        printk(KERN_ERR "Error %d adding aesd%d cdev", err, index);
     }
     return err;
 }
 
+static int aesd_latency_show(struct seq_file *s, void *unused)
+{
+    struct aesd_dev *dev = s->private;
+    struct aesd_op_stats *stats;
+    u64 count;
+    int op;
+    int bucket;
+
+    for (op = 0; op < AESD_OP_COUNT; op++) {
+        stats = &dev->op_stats[op];
+        count = atomic64_read(&stats->count);
+        seq_printf(s, "%s: count %llu errors %llu bytes %llu total_ns %llu lock_wait_ns %llu\n",
+                aesd_op_names[op], count, (u64)atomic64_read(&stats->errors),
+                (u64)atomic64_read(&stats->bytes), (u64)atomic64_read(&stats->total_ns),
+                (u64)atomic64_read(&stats->lock_wait_ns));
+        for (bucket = 0; bucket < AESD_LATENCY_BUCKETS; bucket++) {
+            u64 hits = atomic64_read(&stats->latency_hist[bucket]);
+
+            if (hits != 0) {
+                seq_printf(s, "  < %llu ns: %llu\n", 1ULL << bucket, hits);
+            }
+        }
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(aesd_latency);
+
+static int aesd_compression_show(struct seq_file *s, void *unused)
+{
+    struct aesd_dev *dev = s->private;
+    struct aesd_buffer_entry *entry;
+    u64 input_bytes = atomic64_read(&dev->compressed_input_bytes);
+    u64 output_bytes = atomic64_read(&dev->compressed_output_bytes);
+    u64 resident_bytes = 0;
+    u64 stored_bytes = 0;
+    uint8_t index;
+
+    seq_printf(s, "threshold %u\n", READ_ONCE(aesd_compress_threshold));
+    seq_printf(s, "compressed_entries %llu\n", (u64)atomic64_read(&dev->compressed_entries));
+    seq_printf(s, "compressed_input_bytes %llu\n", input_bytes);
+    seq_printf(s, "compressed_output_bytes %llu\n", output_bytes);
+    // Ratios are reported in percent of the original size
+    seq_printf(s, "compressed_ratio %llu\n", input_bytes ? div64_u64(output_bytes * 100, input_bytes) : 100);
+
+    mutex_lock(&dev->circular_buffer_mutex);
+    AESD_CIRCULAR_BUFFER_FOREACH(entry, &dev->circular_buffer, index) {
+        if (entry->buffptr == NULL) {
+            continue;
+        }
+        resident_bytes += entry->size;
+        if (test_bit(index, dev->compressed_slots)) {
+            stored_bytes += ((const struct aesd_compressed_buf *)entry->buffptr)->compressed_size;
+        }
+        else {
+            stored_bytes += entry->size;
+        }
+    }
+    mutex_unlock(&dev->circular_buffer_mutex);
+    seq_printf(s, "ring_bytes %llu\n", resident_bytes);
+    seq_printf(s, "ring_stored_bytes %llu\n", stored_bytes);
+    seq_printf(s, "ring_ratio %llu\n", resident_bytes ? div64_u64(stored_bytes * 100, resident_bytes) : 100);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(aesd_compression);
+
+static void aesd_debugfs_init_device(struct aesd_dev *dev, int index)
+{
+    char name[16];
+
+    snprintf(name, sizeof(name), "%d", index);
+    dev->debugfs_dir = debugfs_create_dir(name, aesd_debugfs_root);
+    debugfs_create_file("snapshot", 0400, dev->debugfs_dir, dev, &aesd_snapshot_fops);
+    debugfs_create_file("restore", 0200, dev->debugfs_dir, dev, &aesd_restore_fops);
+    debugfs_create_file("latency", 0400, dev->debugfs_dir, dev, &aesd_latency_fops);
+    debugfs_create_file("compression", 0400, dev->debugfs_dir, dev, &aesd_compression_fops);
+}
+
+static int aesd_init_device(struct aesd_dev *dev)
+{
+    BUILD_BUG_ON(sizeof(struct aesd_mmap_header) > PAGE_SIZE);
+
+    // Initialize the circular buffer
+    aesd_circular_buffer_init(&dev->circular_buffer);
+    dev->cached_entry.buffptr = NULL;
+    dev->cached_entry.size = 0;
+    mutex_init(&dev->circular_buffer_mutex);
+    mutex_init(&dev->mmap_mutex);
+    init_waitqueue_head(&dev->read_queue);
+
+    dev->mmap_header = (struct aesd_mmap_header *)get_zeroed_page(GFP_KERNEL);
+    if (dev->mmap_header == NULL) {
+        return -ENOMEM;
+    }
+    dev->mmap_header->magic = AESD_MMAP_MAGIC;
+    dev->mmap_header->version = AESD_MMAP_VERSION;
+    dev->mmap_header->max_entries = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    aesd_mmap_update_header(dev);
+    return 0;
+}
+
+static void aesd_cleanup_device(struct aesd_dev *dev)
+{
+    struct aesd_buffer_entry *entry;
+    uint8_t index;
+
+    AESD_CIRCULAR_BUFFER_FOREACH(entry, &dev->circular_buffer, index) {
+        if (entry->buffptr && !aesd_buffer_entry_is_inline(entry)) {
+            aesd_entry_storage_free(entry->buffptr, entry->size, test_bit(index, dev->compressed_slots));
+            entry->buffptr = NULL;
+        }
+    }
+    kfree(dev->cached_entry.buffptr);
+    kvfree(dev->decompressed_buf);
+    aesd_compress_tfm_free(dev->decompress_tfm);
+
+    if (dev->mmap_inode != NULL) {
+        iput(dev->mmap_inode);
+    }
+    free_page((unsigned long)dev->mmap_header);
+
+    mutex_destroy(&dev->mmap_mutex);
+    mutex_destroy(&dev->circular_buffer_mutex);
+}
+
+void aesd_cleanup_module(void);
+
 int aesd_init_module(void)
 {
     dev_t dev = 0;
     int result;
-    result = alloc_chrdev_region(&dev, aesd_minor, 1,
+    int i;
+
+    if (aesd_nr_devs <= 0) {
+        return -EINVAL;
+    }
+    result = alloc_chrdev_region(&dev, aesd_minor, aesd_nr_devs,
             "aesdchar");
     aesd_major = MAJOR(dev);
     if (result < 0) {
         printk(KERN_WARNING "Can't get major %d\n", aesd_major);
         return result;
     }
-    memset(&aesd_device,0,sizeof(struct aesd_dev));
+    aesd_devices = kcalloc(aesd_nr_devs, sizeof(struct aesd_dev), GFP_KERNEL);
+    if (aesd_devices == NULL) {
+        unregister_chrdev_region(dev, aesd_nr_devs);
+        return -ENOMEM;
+    }
 
     /**
      * TODO: initialize the AESD specific portion of the device
      */
-    // Initialize the circular buffer
-    aesd_circular_buffer_init(&aesd_device.circular_buffer);
-    aesd_device.cached_entry.buffptr = NULL;
-    aesd_device.cached_entry.size = 0;
-    mutex_init(&aesd_device.circular_buffer_mutex);
-    
-    result = aesd_setup_cdev(&aesd_device);
-
-    if( result ) {
-        unregister_chrdev_region(dev, 1);
+    aesd_debugfs_root = debugfs_create_dir("aesdchar", NULL);
+    for (i = 0; i < aesd_nr_devs; i++) {
+        result = aesd_init_device(&aesd_devices[i]);
+        if (result) {
+            goto fail;
+        }
+        aesd_debugfs_init_device(&aesd_devices[i], i);
     }
-    return result;
+    for (i = 0; i < aesd_nr_devs; i++) {
+        result = aesd_setup_cdev(&aesd_devices[i], i);
+        if (result) {
+            goto fail;
+        }
+    }
+    return 0;
 
+fail:
+    aesd_cleanup_module();
+    return result;
 }
 
 void aesd_cleanup_module(void)
 {
-    struct aesd_buffer_entry *entry;
-    uint8_t index;
     dev_t devno = MKDEV(aesd_major, aesd_minor);
-
-    cdev_del(&aesd_device.cdev);
+    int i;
 
     /**
      * TODO: cleanup AESD specific poritions here as necessary
      */
-    AESD_CIRCULAR_BUFFER_FOREACH(entry, &aesd_device.circular_buffer, index) {
-        if (entry->buffptr) {
-            kfree(entry->buffptr);
-            entry->buffptr = NULL;
+    // Remove debugfs first, its files reference the devices freed below
+    debugfs_remove_recursive(aesd_debugfs_root);
+    aesd_debugfs_root = NULL;
+
+    if (aesd_devices != NULL) {
+        for (i = 0; i < aesd_nr_devs; i++) {
+            // Skip devices which never reached aesd_setup_cdev
+            if (aesd_devices[i].cdev.ops != NULL) {
+                cdev_del(&aesd_devices[i].cdev);
+            }
+            aesd_cleanup_device(&aesd_devices[i]);
         }
+        kfree(aesd_devices);
+        aesd_devices = NULL;
     }
 
-    mutex_destroy(&aesd_device.circular_buffer_mutex);
-
-    unregister_chrdev_region(devno, 1);
+    unregister_chrdev_region(devno, aesd_nr_devs);
 }
 
 module_init(aesd_init_module);
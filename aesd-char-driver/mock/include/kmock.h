@@ -0,0 +1,503 @@
+/*
+ * kmock.h
+ *
+ *  @brief Userspace stand-ins for the kernel interfaces used by the aesdchar driver
+ *
+ *  Every <linux/...> header included by main.c resolves to a file under mock/include which
+ *  includes this one, so main.c builds unchanged as a userspace library.  Locks, wait queues,
+ *  allocation and user copies behave like their kernel counterparts; interfaces which can't be
+ *  emulated in a process (page mapping, tracepoints) are no-ops or fail with an error.  Only
+ *  what the driver uses is provided.
+ */
+
+#ifndef AESD_KMOCK_H
+#define AESD_KMOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/* Types */
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef long long s64;
+typedef unsigned int gfp_t;
+typedef unsigned int fmode_t;
+typedef unsigned int __poll_t;
+typedef unsigned int vm_fault_t;
+
+#define __user
+
+/* Compiler and kernel.h helpers */
+
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#define READ_ONCE(x) (*(const volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, val) (*(volatile __typeof__(x) *)&(x) = (val))
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(type, a, b) ((type)(a) < (type)(b) ? (type)(a) : (type)(b))
+#define max_t(type, a, b) ((type)(a) > (type)(b) ? (type)(a) : (type)(b))
+#define ALIGN(x, a) (((x) + ((__typeof__(x))(a) - 1)) & ~((__typeof__(x))(a) - 1))
+#define BUILD_BUG_ON(condition) _Static_assert(!(condition), #condition)
+#define ERESTARTSYS 512
+
+static inline void *ERR_PTR(long error)
+{
+    return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+    return (long)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+    return (unsigned long)ptr >= (unsigned long)-4095;
+}
+
+static inline int fls64(u64 x)
+{
+    return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+    return dividend / divisor;
+}
+
+/* printk */
+
+#define KERN_ERR     "<3>"
+#define KERN_WARNING "<4>"
+#define KERN_INFO    "<6>"
+#define KERN_DEBUG   "<7>"
+#define printk(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
+
+/* Modules */
+
+struct module;
+#define THIS_MODULE ((struct module *)NULL)
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_PARM_DESC(name, desc)
+#define module_param(name, type, perm)
+#define module_init(fn)
+#define module_exit(fn)
+#define __init
+#define __exit
+#define S_IRUGO 0444
+
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 6, 0)
+
+/* Atomics and bitops, the driver only updates bitmaps under its own locks */
+
+typedef struct {
+    s64 counter;
+} atomic64_t;
+
+static inline s64 atomic64_read(const atomic64_t *v)
+{
+    return __atomic_load_n(&v->counter, __ATOMIC_RELAXED);
+}
+
+static inline void atomic64_add(s64 i, atomic64_t *v)
+{
+    __atomic_fetch_add(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+static inline void atomic64_inc(atomic64_t *v)
+{
+    atomic64_add(1, v);
+}
+
+#define BITS_PER_LONG (8 * sizeof(long))
+#define BITS_TO_LONGS(nr) (((nr) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits) unsigned long name[BITS_TO_LONGS(bits)]
+
+static inline bool test_bit(long nr, const volatile unsigned long *addr)
+{
+    return (addr[nr / BITS_PER_LONG] >> (nr % BITS_PER_LONG)) & 1;
+}
+
+static inline void assign_bit(long nr, volatile unsigned long *addr, bool value)
+{
+    if (value) {
+        addr[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+    }
+    else {
+        addr[nr / BITS_PER_LONG] &= ~(1UL << (nr % BITS_PER_LONG));
+    }
+}
+
+/* Time */
+
+static inline u64 ktime_get_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Mutexes and wait queues */
+
+struct mutex {
+    pthread_mutex_t lock;
+};
+
+static inline void mutex_init(struct mutex *lock)
+{
+    pthread_mutex_init(&lock->lock, NULL);
+}
+
+static inline void mutex_destroy(struct mutex *lock)
+{
+    pthread_mutex_destroy(&lock->lock);
+}
+
+static inline void mutex_lock(struct mutex *lock)
+{
+    pthread_mutex_lock(&lock->lock);
+}
+
+/* Signals are never delivered to the mock, so this can't be interrupted */
+static inline int mutex_lock_interruptible(struct mutex *lock)
+{
+    pthread_mutex_lock(&lock->lock);
+    return 0;
+}
+
+static inline void mutex_unlock(struct mutex *lock)
+{
+    pthread_mutex_unlock(&lock->lock);
+}
+
+typedef struct wait_queue_head {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} wait_queue_head_t;
+
+static inline void init_waitqueue_head(wait_queue_head_t *wq)
+{
+    pthread_mutex_init(&wq->lock, NULL);
+    pthread_cond_init(&wq->cond, NULL);
+}
+
+static inline void wake_up_interruptible(wait_queue_head_t *wq)
+{
+    pthread_mutex_lock(&wq->lock);
+    pthread_cond_broadcast(&wq->cond);
+    pthread_mutex_unlock(&wq->lock);
+}
+
+/* The condition is rechecked under wq.lock, which wake_up_interruptible takes, so no wakeup is lost */
+#define wait_event_interruptible(wq, condition) ({              \
+    pthread_mutex_lock(&(wq).lock);                             \
+    while (!(condition)) {                                      \
+        pthread_cond_wait(&(wq).cond, &(wq).lock);              \
+    }                                                           \
+    pthread_mutex_unlock(&(wq).lock);                           \
+    0;                                                          \
+})
+
+/* Memory */
+
+#define GFP_KERNEL 0
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1UL << PAGE_SHIFT)
+#define PAGE_ALIGN(x) ALIGN((unsigned long)(x), PAGE_SIZE)
+
+static inline void *kmalloc(size_t size, gfp_t flags)
+{
+    return malloc(size);
+}
+
+static inline void *kzalloc(size_t size, gfp_t flags)
+{
+    return calloc(1, size);
+}
+
+static inline void *kcalloc(size_t n, size_t size, gfp_t flags)
+{
+    return calloc(n, size);
+}
+
+static inline void *krealloc(const void *ptr, size_t size, gfp_t flags)
+{
+    return realloc((void *)ptr, size);
+}
+
+static inline void kfree(const void *ptr)
+{
+    free((void *)ptr);
+}
+
+#define kvmalloc kmalloc
+#define kvzalloc kzalloc
+#define kvfree kfree
+
+struct page;
+
+static inline void *alloc_pages_exact(size_t size, gfp_t flags)
+{
+    return aligned_alloc(PAGE_SIZE, PAGE_ALIGN(size));
+}
+
+static inline void free_pages_exact(void *ptr, size_t size)
+{
+    free(ptr);
+}
+
+static inline unsigned long get_zeroed_page(gfp_t flags)
+{
+    void *page = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+
+    if (page != NULL) {
+        memset(page, 0, PAGE_SIZE);
+    }
+    return (unsigned long)page;
+}
+
+static inline void free_page(unsigned long addr)
+{
+    free((void *)addr);
+}
+
+static inline struct page *virt_to_page(const void *addr)
+{
+    return (struct page *)addr;
+}
+
+/* User memory is ordinary process memory */
+
+static inline unsigned long copy_to_user(void __user *to, const void *from, unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void __user *from, unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+
+static inline void __user *u64_to_user_ptr(u64 address)
+{
+    return (void __user *)(uintptr_t)address;
+}
+
+/* Files */
+
+struct address_space {
+    int unused;
+};
+
+struct cdev;
+
+struct inode {
+    struct address_space *i_mapping;
+    struct cdev *i_cdev;
+    void *i_private;
+};
+
+struct file {
+    void *private_data;
+    loff_t f_pos;
+    unsigned int f_flags;
+    fmode_t f_mode;
+    struct inode *f_inode;
+};
+
+struct vm_area_struct;
+struct vm_fault;
+struct poll_table_struct;
+
+struct file_operations {
+    struct module *owner;
+    loff_t (*llseek)(struct file *, loff_t, int);
+    ssize_t (*read)(struct file *, char __user *, size_t, loff_t *);
+    ssize_t (*write)(struct file *, const char __user *, size_t, loff_t *);
+    __poll_t (*poll)(struct file *, struct poll_table_struct *);
+    long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+    int (*mmap)(struct file *, struct vm_area_struct *);
+    int (*open)(struct inode *, struct file *);
+    int (*release)(struct inode *, struct file *);
+};
+
+static inline struct inode *file_inode(const struct file *filp)
+{
+    return filp->f_inode;
+}
+
+static inline void ihold(struct inode *inode)
+{
+}
+
+static inline void iput(struct inode *inode)
+{
+}
+
+extern loff_t fixed_size_llseek(struct file *filp, loff_t offset, int whence, loff_t size);
+extern loff_t default_llseek(struct file *filp, loff_t offset, int whence);
+extern ssize_t simple_read_from_buffer(void __user *to, size_t count, loff_t *ppos, const void *from,
+            size_t available);
+
+/* Character devices */
+
+#define MINORBITS 20
+#define MAJOR(dev) ((unsigned int)((dev) >> MINORBITS))
+#define MINOR(dev) ((unsigned int)((dev) & ((1U << MINORBITS) - 1)))
+#define MKDEV(ma, mi) (((dev_t)(ma) << MINORBITS) | (mi))
+
+struct cdev {
+    struct module *owner;
+    const struct file_operations *ops;
+    dev_t dev;
+};
+
+extern int alloc_chrdev_region(dev_t *dev, unsigned int baseminor, unsigned int count, const char *name);
+extern void unregister_chrdev_region(dev_t from, unsigned int count);
+extern void cdev_init(struct cdev *cdev, const struct file_operations *fops);
+extern int cdev_add(struct cdev *cdev, dev_t dev, unsigned int count);
+extern void cdev_del(struct cdev *cdev);
+
+/* Poll */
+
+typedef struct poll_table_struct {
+    int unused;
+} poll_table;
+
+#define EPOLLIN     0x00000001
+#define EPOLLOUT    0x00000004
+#define EPOLLRDNORM 0x00000040
+#define EPOLLWRNORM 0x00000100
+
+static inline void poll_wait(struct file *filp, wait_queue_head_t *wq, poll_table *wait)
+{
+}
+
+/* Memory mapping, accepted but never backed by real mappings */
+
+#define VM_WRITE      0x00000002
+#define VM_MAYWRITE   0x00000020
+#define VM_DONTEXPAND 0x00040000
+#define VM_MIXEDMAP   0x10000000
+#define VM_DONTDUMP   0x04000000
+#define VM_FAULT_SIGBUS 0x0002
+#define VM_FAULT_NOPAGE 0x0100
+
+struct vm_operations_struct {
+    vm_fault_t (*fault)(struct vm_fault *vmf);
+};
+
+struct vm_area_struct {
+    unsigned long vm_start;
+    unsigned long vm_end;
+    unsigned long vm_pgoff;
+    unsigned long vm_flags;
+    const struct vm_operations_struct *vm_ops;
+    void *vm_private_data;
+};
+
+struct vm_fault {
+    struct vm_area_struct *vma;
+    unsigned long pgoff;
+    unsigned long address;
+};
+
+static inline unsigned long vma_pages(struct vm_area_struct *vma)
+{
+    return (vma->vm_end - vma->vm_start) >> PAGE_SHIFT;
+}
+
+static inline void vm_flags_mod(struct vm_area_struct *vma, unsigned long set, unsigned long clear)
+{
+    vma->vm_flags = (vma->vm_flags | set) & ~clear;
+}
+
+static inline int vm_insert_page(struct vm_area_struct *vma, unsigned long addr, struct page *page)
+{
+    return -EFAULT;
+}
+
+static inline vm_fault_t vmf_error(int err)
+{
+    return VM_FAULT_SIGBUS;
+}
+
+static inline void unmap_mapping_range(struct address_space *mapping, loff_t start, loff_t len, int even_cows)
+{
+}
+
+/* seq_file and debugfs */
+
+struct seq_file {
+    char *buf;
+    size_t size;
+    size_t count;
+    void *private;
+};
+
+extern void seq_printf(struct seq_file *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+extern int single_open(struct file *filp, int (*show)(struct seq_file *, void *), void *data);
+extern int single_release(struct inode *inode, struct file *filp);
+extern ssize_t seq_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos);
+#define seq_lseek default_llseek
+
+#define DEFINE_SHOW_ATTRIBUTE(__name)                                   \
+static int __name ## _open(struct inode *inode, struct file *file)     \
+{                                                                       \
+    return single_open(file, __name ## _show, inode->i_private);       \
+}                                                                       \
+                                                                        \
+static const struct file_operations __name ## _fops = {                 \
+    .owner      = THIS_MODULE,                                          \
+    .open       = __name ## _open,                                      \
+    .read       = seq_read,                                             \
+    .llseek     = seq_lseek,                                            \
+    .release    = single_release,                                       \
+}
+
+/**
+ * debugfs entries are kept in a tree in memory, see kmock_debugfs_open to open them
+ */
+struct dentry {
+    char name[64];
+    struct dentry *parent;
+    struct dentry *child;
+    struct dentry *sibling;
+    struct inode inode;
+    const struct file_operations *fops;
+};
+
+extern struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+extern struct dentry *debugfs_create_file(const char *name, unsigned short mode, struct dentry *parent,
+            void *data, const struct file_operations *fops);
+extern void debugfs_remove_recursive(struct dentry *dentry);
+
+/**
+ * Open the debugfs file at @param path, relative to the debugfs root, into @param filp.
+ * @return the file's operations, or NULL if it doesn't exist or can't be opened
+ */
+extern const struct file_operations *kmock_debugfs_open(const char *path, struct file *filp);
+
+#endif /* AESD_KMOCK_H */
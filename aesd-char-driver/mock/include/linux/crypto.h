@@ -0,0 +1,20 @@
+#include <kmock.h>
+
+/*
+ * The "lz4" algorithm of the kernel's crypto compress API on top of liblz4 when the mock is built
+ * with AESD_KMOCK_HAVE_LZ4.  Otherwise no algorithm is available and crypto_alloc_comp fails, so
+ * records are stored uncompressed.
+ */
+#ifndef AESD_KMOCK_CRYPTO_H
+#define AESD_KMOCK_CRYPTO_H
+
+struct crypto_comp;
+
+extern struct crypto_comp *crypto_alloc_comp(const char *alg_name, u32 type, u32 mask);
+extern void crypto_free_comp(struct crypto_comp *tfm);
+extern int crypto_comp_compress(struct crypto_comp *tfm, const u8 *src, unsigned int slen,
+                u8 *dst, unsigned int *dlen);
+extern int crypto_comp_decompress(struct crypto_comp *tfm, const u8 *src, unsigned int slen,
+                u8 *dst, unsigned int *dlen);
+
+#endif /* AESD_KMOCK_CRYPTO_H */
@@ -0,0 +1,15 @@
+#include <kmock.h>
+
+/* Tracepoints compile to empty trace_<event>() functions */
+#ifndef AESD_KMOCK_TRACEPOINT_H
+#define AESD_KMOCK_TRACEPOINT_H
+
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...) args
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+    static inline void trace_##name(proto) {}
+#define DECLARE_EVENT_CLASS(name, proto, args, tstruct, assign, print)
+#define DEFINE_EVENT(template, name, proto, args) \
+    static inline void trace_##name(proto) {}
+
+#endif /* AESD_KMOCK_TRACEPOINT_H */
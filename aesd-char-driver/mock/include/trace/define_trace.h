@@ -0,0 +1 @@
+/* Tracepoints are empty in the mock, see linux/tracepoint.h */
@@ -0,0 +1,349 @@
+/**
+ * @file kmock.c
+ * @brief Userspace implementations of the kernel interfaces declared in kmock.h which are too
+ * large to inline
+ */
+
+#include <stdarg.h>
+#include "kmock.h"
+
+#ifdef AESD_KMOCK_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include <linux/crypto.h>
+
+#define KMOCK_CHRDEV_MAJOR 240 // first of the majors reserved for local/experimental use
+
+/**
+ * Root of the debugfs tree, parent of every entry created with a NULL parent
+ */
+static struct dentry debugfs_root;
+static pthread_mutex_t debugfs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * State of a file opened with single_open
+ */
+struct kmock_single {
+    struct seq_file seq;
+    int (*show)(struct seq_file *, void *);
+    bool shown;
+};
+
+loff_t fixed_size_llseek(struct file *filp, loff_t offset, int whence, loff_t size)
+{
+    switch (whence) {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += filp->f_pos;
+        break;
+    case SEEK_END:
+        offset += size;
+        break;
+    default:
+        return -EINVAL;
+    }
+    if ((offset < 0) || (offset > size)) {
+        return -EINVAL;
+    }
+    filp->f_pos = offset;
+    return offset;
+}
+
+loff_t default_llseek(struct file *filp, loff_t offset, int whence)
+{
+    switch (whence) {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += filp->f_pos;
+        break;
+    default:
+        return -EINVAL;
+    }
+    if (offset < 0) {
+        return -EINVAL;
+    }
+    filp->f_pos = offset;
+    return offset;
+}
+
+ssize_t simple_read_from_buffer(void __user *to, size_t count, loff_t *ppos, const void *from, size_t available)
+{
+    loff_t pos = *ppos;
+
+    if (pos < 0) {
+        return -EINVAL;
+    }
+    if ((size_t)pos >= available || count == 0) {
+        return 0;
+    }
+    if (count > available - pos) {
+        count = available - pos;
+    }
+    memcpy(to, (const char *)from + pos, count);
+    *ppos = pos + count;
+    return count;
+}
+
+int alloc_chrdev_region(dev_t *dev, unsigned int baseminor, unsigned int count, const char *name)
+{
+    *dev = MKDEV(KMOCK_CHRDEV_MAJOR, baseminor);
+    return 0;
+}
+
+void unregister_chrdev_region(dev_t from, unsigned int count)
+{
+}
+
+void cdev_init(struct cdev *cdev, const struct file_operations *fops)
+{
+    memset(cdev, 0, sizeof(struct cdev));
+    cdev->ops = fops;
+}
+
+int cdev_add(struct cdev *cdev, dev_t dev, unsigned int count)
+{
+    cdev->dev = dev;
+    return 0;
+}
+
+void cdev_del(struct cdev *cdev)
+{
+}
+
+void seq_printf(struct seq_file *s, const char *fmt, ...)
+{
+    va_list args;
+    size_t needed;
+    char *buf;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (len < 0) {
+        return;
+    }
+
+    needed = s->count + len + 1;
+    if (needed > s->size) {
+        buf = realloc(s->buf, needed * 2);
+        if (buf == NULL) {
+            return;
+        }
+        s->buf = buf;
+        s->size = needed * 2;
+    }
+    va_start(args, fmt);
+    vsnprintf(&s->buf[s->count], s->size - s->count, fmt, args);
+    va_end(args);
+    s->count += len;
+}
+
+int single_open(struct file *filp, int (*show)(struct seq_file *, void *), void *data)
+{
+    struct kmock_single *single = calloc(1, sizeof(struct kmock_single));
+
+    if (single == NULL) {
+        return -ENOMEM;
+    }
+    single->seq.private = data;
+    single->show = show;
+    filp->private_data = single;
+    return 0;
+}
+
+int single_release(struct inode *inode, struct file *filp)
+{
+    struct kmock_single *single = filp->private_data;
+
+    free(single->seq.buf);
+    free(single);
+    return 0;
+}
+
+ssize_t seq_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos)
+{
+    struct kmock_single *single = filp->private_data;
+    int result;
+
+    // The whole file is generated on the first read, like seq_file does for single_open
+    if (!single->shown) {
+        result = single->show(&single->seq, NULL);
+        if (result) {
+            return result;
+        }
+        single->shown = true;
+    }
+    return simple_read_from_buffer(buf, count, ppos, single->seq.buf, single->seq.count);
+}
+
+static struct dentry *debugfs_create(const char *name, struct dentry *parent, void *data,
+            const struct file_operations *fops)
+{
+    struct dentry *dentry = calloc(1, sizeof(struct dentry));
+
+    if (dentry == NULL) {
+        return ERR_PTR(-ENOMEM);
+    }
+    snprintf(dentry->name, sizeof(dentry->name), "%s", name);
+    dentry->inode.i_private = data;
+    dentry->fops = fops;
+
+    pthread_mutex_lock(&debugfs_mutex);
+    dentry->parent = (parent != NULL) ? parent : &debugfs_root;
+    dentry->sibling = dentry->parent->child;
+    dentry->parent->child = dentry;
+    pthread_mutex_unlock(&debugfs_mutex);
+    return dentry;
+}
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent)
+{
+    return debugfs_create(name, parent, NULL, NULL);
+}
+
+struct dentry *debugfs_create_file(const char *name, unsigned short mode, struct dentry *parent,
+            void *data, const struct file_operations *fops)
+{
+    return debugfs_create(name, parent, data, fops);
+}
+
+static void debugfs_free_children(struct dentry *dentry)
+{
+    struct dentry *child = dentry->child;
+    struct dentry *next;
+
+    while (child != NULL) {
+        next = child->sibling;
+        debugfs_free_children(child);
+        free(child);
+        child = next;
+    }
+    dentry->child = NULL;
+}
+
+void debugfs_remove_recursive(struct dentry *dentry)
+{
+    struct dentry **link;
+
+    if ((dentry == NULL) || IS_ERR(dentry)) {
+        return;
+    }
+    pthread_mutex_lock(&debugfs_mutex);
+    for (link = &dentry->parent->child; *link != NULL; link = &(*link)->sibling) {
+        if (*link == dentry) {
+            *link = dentry->sibling;
+            break;
+        }
+    }
+    debugfs_free_children(dentry);
+    free(dentry);
+    pthread_mutex_unlock(&debugfs_mutex);
+}
+
+const struct file_operations *kmock_debugfs_open(const char *path, struct file *filp)
+{
+    struct dentry *dentry = &debugfs_root;
+    const char *name = path;
+    size_t name_len;
+
+    pthread_mutex_lock(&debugfs_mutex);
+    while ((dentry != NULL) && (*name != '\0')) {
+        name_len = strcspn(name, "/");
+        for (dentry = dentry->child; dentry != NULL; dentry = dentry->sibling) {
+            if ((strlen(dentry->name) == name_len) && (strncmp(dentry->name, name, name_len) == 0)) {
+                break;
+            }
+        }
+        name += name_len;
+        name += (*name == '/');
+    }
+    pthread_mutex_unlock(&debugfs_mutex);
+
+    if ((dentry == NULL) || (dentry->fops == NULL)) {
+        return NULL;
+    }
+    memset(filp, 0, sizeof(struct file));
+    filp->f_inode = &dentry->inode;
+    if ((dentry->fops->open != NULL) && dentry->fops->open(&dentry->inode, filp)) {
+        return NULL;
+    }
+    return dentry->fops;
+}
+
+struct crypto_comp {
+    void *wrkmem;
+};
+
+#ifdef AESD_KMOCK_HAVE_LZ4
+struct crypto_comp *crypto_alloc_comp(const char *alg_name, u32 type, u32 mask)
+{
+    struct crypto_comp *tfm;
+
+    if (strcmp(alg_name, "lz4") != 0) {
+        return ERR_PTR(-ENOENT);
+    }
+    tfm = malloc(sizeof(struct crypto_comp));
+    if (tfm == NULL) {
+        return ERR_PTR(-ENOMEM);
+    }
+    tfm->wrkmem = malloc(LZ4_sizeofState());
+    if (tfm->wrkmem == NULL) {
+        free(tfm);
+        return ERR_PTR(-ENOMEM);
+    }
+    return tfm;
+}
+
+int crypto_comp_compress(struct crypto_comp *tfm, const u8 *src, unsigned int slen,
+                u8 *dst, unsigned int *dlen)
+{
+    int out_len = LZ4_compress_fast_extState(tfm->wrkmem, (const char *)src, (char *)dst, slen, *dlen, 1);
+
+    if (out_len <= 0) {
+        return -EINVAL;
+    }
+    *dlen = out_len;
+    return 0;
+}
+
+int crypto_comp_decompress(struct crypto_comp *tfm, const u8 *src, unsigned int slen,
+                u8 *dst, unsigned int *dlen)
+{
+    int out_len = LZ4_decompress_safe((const char *)src, (char *)dst, slen, *dlen);
+
+    if (out_len < 0) {
+        return -EINVAL;
+    }
+    *dlen = out_len;
+    return 0;
+}
+#else
+struct crypto_comp *crypto_alloc_comp(const char *alg_name, u32 type, u32 mask)
+{
+    return ERR_PTR(-ENOENT);
+}
+
+int crypto_comp_compress(struct crypto_comp *tfm, const u8 *src, unsigned int slen,
+                u8 *dst, unsigned int *dlen)
+{
+    return -EINVAL;
+}
+
+int crypto_comp_decompress(struct crypto_comp *tfm, const u8 *src, unsigned int slen,
+                u8 *dst, unsigned int *dlen)
+{
+    return -EINVAL;
+}
+#endif
+
+void crypto_free_comp(struct crypto_comp *tfm)
+{
+    if (tfm != NULL) {
+        free(tfm->wrkmem);
+        free(tfm);
+    }
+}
@@ -7,6 +7,7 @@
 */
 
 
+#define _GNU_SOURCE // pipe2, wait4
 #include "systemcalls.h"
 #include "stdlib.h"
 #include <sys/types.h>
@@ -14,6 +15,172 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <limits.h>
+
+extern char **environ;
+
+static enum exec_method exec_method = EXEC_METHOD_SPAWN;
+
+/**
+ * @param method how do_exec and do_exec_redirect start commands from now on
+ */
+void set_exec_method(enum exec_method method)
+{
+    exec_method = method;
+}
+
+/**
+ * @return the method do_exec and do_exec_redirect use to start commands
+ */
+enum exec_method get_exec_method(void)
+{
+    return exec_method;
+}
+
+/**
+ * How start_command sets up the child
+ */
+struct start_options
+{
+    /**
+     * Descriptors to become the child's standard out and standard error, -1 to inherit ours
+     */
+    int stdout_fd;
+    int stderr_fd;
+    /**
+     * Resource limits applied to the child before it executes the command
+     */
+    const struct exec_rlimit *rlimits;
+    size_t rlimit_count;
+    /**
+     * cgroup.procs file of the cgroup the child moves itself into, -1 for none
+     */
+    int cgroup_procs_fd;
+};
+
+static const struct start_options default_start_options = {
+    .stdout_fd = -1,
+    .stderr_fd = -1,
+    .cgroup_procs_fd = -1,
+};
+
+/**
+ * Start @param command[0] with arguments @param command, set up as described by @param options.
+ * @return the pid of the child, or -1 if it could not be started
+ */
+static pid_t start_command(char *const command[], const struct start_options *options)
+{
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+    int result;
+
+    fflush(stdout);
+    // posix_spawn can't change limits or the cgroup of the child before it executes the command
+    if ((exec_method == EXEC_METHOD_FORK) || (options->rlimit_count > 0) || (options->cgroup_procs_fd >= 0))
+    {
+        pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            return -1;
+        }
+        if (pid == 0)
+        {
+            if (((options->stdout_fd >= 0) && (dup2(options->stdout_fd, STDOUT_FILENO) < 0)) ||
+                ((options->stderr_fd >= 0) && (dup2(options->stderr_fd, STDERR_FILENO) < 0)))
+            {
+                perror("dup2");
+                _exit(EXIT_FAILURE);
+            }
+            for (size_t i = 0; i < options->rlimit_count; i++)
+            {
+                if (setrlimit(options->rlimits[i].resource, &options->rlimits[i].limit) < 0)
+                {
+                    perror("setrlimit");
+                    _exit(EXIT_FAILURE);
+                }
+            }
+            // Writing 0 to cgroup.procs moves the writer
+            if ((options->cgroup_procs_fd >= 0) && (write(options->cgroup_procs_fd, "0", 1) < 0))
+            {
+                perror("cgroup.procs");
+                _exit(EXIT_FAILURE);
+            }
+            execv(command[0], command);
+            perror("execv");
+            _exit(EXIT_FAILURE);
+        }
+        return pid;
+    }
+
+    // posix_spawn doesn't copy the parent's page tables, so its cost doesn't grow with our RSS
+    result = posix_spawn_file_actions_init(&actions);
+    if (result != 0)
+    {
+        fprintf(stderr, "posix_spawn_file_actions_init: %s\n", strerror(result));
+        return -1;
+    }
+    if (options->stdout_fd >= 0)
+    {
+        result = posix_spawn_file_actions_adddup2(&actions, options->stdout_fd, STDOUT_FILENO);
+    }
+    if ((result == 0) && (options->stderr_fd >= 0))
+    {
+        result = posix_spawn_file_actions_adddup2(&actions, options->stderr_fd, STDERR_FILENO);
+    }
+    if (result == 0)
+    {
+        result = posix_spawn(&pid, command[0], &actions, NULL, command, environ);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    if (result != 0)
+    {
+        fprintf(stderr, "posix_spawn %s: %s\n", command[0], strerror(result));
+        return -1;
+    }
+    return pid;
+}
+
+/**
+ * Wait for the child @param pid started by start_command to exit, storing its wait status in
+ * @param status_rtn and its resource usage in @param usage_rtn when they are not NULL.
+ * @return true if it exited with status 0
+ */
+static bool wait_command(pid_t pid, int *status_rtn, struct rusage *usage_rtn)
+{
+    int status;
+
+    while (wait4(pid, &status, 0, usage_rtn) < 0)
+    {
+        if (errno != EINTR)
+        {
+            perror("wait4");
+            return false;
+        }
+    }
+    if (status_rtn != NULL)
+    {
+        *status_rtn = status;
+    }
+    // A child which failed to exec exits with EXIT_FAILURE, so it counts as a failure here too
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
 
 /**
@@ -74,42 +241,14 @@ bool do_exec(int count, ...)
  *   as second argument to the execv() command.
  *
 */
-    fflush(stdout);
-    // Create a child process
-    pid_t pid = fork();
+    va_end(args);
 
-    // Check for the failure
+    pid_t pid = start_command(command, &default_start_options);
     if (pid < 0)
     {
-        perror("fork");
         return false;
     }
-    else if (pid > 0)
-    {
-        int status;
-        // Wait for the child process to complete
-        waitpid(pid, &status, 0);
-        if (WIFEXITED(status))
-        {
-            // Child process executed successfully
-            int ret_code = WEXITSTATUS(status); 
-            return ((ret_code == 0) ? true : false); 
-        }
-        else
-        {
-            // Child process did not terminate normally
-            return false;
-        }
-    }
-    else
-    {
-        // Store the execute command in a interger
-        int ret_code = execv(command[0], command);
-        perror("execv");
-        exit(ret_code);
-    }
-    va_end(args);
-    return false;
+    return wait_command(pid, NULL, NULL);
 }
 
 /**
@@ -140,58 +279,486 @@ bool do_exec_redirect(const char *outputfile, int count, ...)
  *   The rest of the behaviour is same as do_exec()
  *
 */
-    // Open the outputfile with right permissiom
-    int fd = open(outputfile, O_WRONLY|O_TRUNC|O_CREAT, 0644);
+    va_end(args);
+
+    // Open the outputfile with right permissiom, close-on-exec so only the redirected copy reaches the child
+    int fd = open(outputfile, O_WRONLY|O_TRUNC|O_CREAT|O_CLOEXEC, 0644);
     // Check outputfile fail to open
     if (fd < 0) 
     {
         perror("open");
         abort();
     }
-    fflush(stdout);
-    // Create a child proccess
-    pid_t pid = fork();
 
-    // Check for the failure
+    struct start_options options = default_start_options;
+    options.stdout_fd = fd;
+    pid_t pid = start_command(command, &options);
+    close(fd);
+    if (pid < 0)
+    {
+        return false;
+    }
+    return wait_command(pid, NULL, NULL);
+}
+
+/**
+ * A command started by do_exec_batch which has not been reaped yet
+ */
+struct batch_child
+{
+    pid_t pid;
+    /**
+     * pidfd of the child, polled to learn when it exits, or -1 if pidfds are unsupported
+     */
+    int pidfd;
+    size_t index;
+    uint64_t start_ns;
+};
+
+/**
+ * Reap @param child, which has exited or is waited for here, into its entry of @param results.
+ * @return true if it exited with status 0
+ */
+static bool finish_batch_child(struct batch_child *child, struct exec_result results[])
+{
+    struct exec_result *result = &results[child->index];
+
+    result->success = wait_command(child->pid, &result->status, &result->usage);
+    result->elapsed_ns = monotonic_ns() - child->start_ns;
+    if (child->pidfd >= 0)
+    {
+        close(child->pidfd);
+    }
+    return result->success;
+}
+
+/**
+* @param commands - @param count commands to run, each a NULL terminated argument list whose first
+*   element is the full path to the command, as for do_exec
+* @param max_parallel - The maximum number of commands running at once, 0 for the number of online CPUs
+* @param results - Filled with the outcome of each command, in the order of @param commands
+* @return true if every command was started and exited with status 0.  All commands are run even
+*   if some of them fail.
+*/
+bool do_exec_batch(char *const *const commands[], size_t count, unsigned int max_parallel,
+                   struct exec_result results[])
+{
+    struct batch_child *children;
+    struct pollfd *fds;
+    size_t next = 0;
+    size_t active = 0;
+    size_t i;
+    bool all_success = true;
+    bool use_poll;
+    long cpus;
+
+    if (max_parallel == 0)
+    {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_parallel = (cpus > 0) ? cpus : 1;
+    }
+    if (max_parallel > count)
+    {
+        max_parallel = (count > 0) ? count : 1;
+    }
+    children = calloc(max_parallel, sizeof(struct batch_child));
+    fds = calloc(max_parallel, sizeof(struct pollfd));
+    if ((children == NULL) || (fds == NULL))
+    {
+        perror("calloc");
+        free(children);
+        free(fds);
+        return false;
+    }
+
+    while ((next < count) || (active > 0))
+    {
+        // Keep max_parallel commands running
+        while ((next < count) && (active < max_parallel))
+        {
+            struct batch_child *child = &children[active];
+
+            memset(&results[next], 0, sizeof(struct exec_result));
+            child->index = next++;
+            child->start_ns = monotonic_ns();
+            child->pid = start_command(commands[child->index], &default_start_options);
+            if (child->pid < 0)
+            {
+                results[child->index].status = -1;
+                all_success = false;
+                continue;
+            }
+            child->pidfd = syscall(SYS_pidfd_open, child->pid, 0);
+            active++;
+        }
+        if (active == 0)
+        {
+            break;
+        }
+
+        // Reap whichever children exit first when pidfds are available, else the oldest
+        use_poll = true;
+        for (i = 0; i < active; i++)
+        {
+            fds[i].fd = children[i].pidfd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+            use_poll = use_poll && (children[i].pidfd >= 0);
+        }
+        if (!use_poll)
+        {
+            fds[0].revents = POLLIN;
+        }
+        else if (poll(fds, active, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            fds[0].revents = POLLIN; // Fall back to a blocking wait on the oldest
+        }
+
+        for (i = active; i-- > 0; )
+        {
+            if (fds[i].revents == 0)
+            {
+                continue;
+            }
+            if (!finish_batch_child(&children[i], results))
+            {
+                all_success = false;
+            }
+            // Keep children in start order so the fallback always waits on the oldest
+            memmove(&children[i], &children[i + 1], (active - i - 1) * sizeof(struct batch_child));
+            active--;
+        }
+    }
+
+    free(children);
+    free(fds);
+    return all_success;
+}
+
+/**
+ * Read what is available on the non-blocking pipe @param fd and pass it to @param callback.
+ * @return 1 on end of file, 0 if the pipe should be polled again, -1 if the callback asked to
+ *   stop or reading failed
+ */
+static int stream_pipe(int fd, int stream, exec_output_callback callback, void *context)
+{
+    char buf[EXEC_CAPTURE_CHUNK_SIZE];
+    ssize_t len;
+
+    for (;;)
+    {
+        len = read(fd, buf, sizeof(buf));
+        if (len > 0)
+        {
+            if (!callback(stream, buf, len, context))
+            {
+                return -1;
+            }
+            continue;
+        }
+        if (len == 0)
+        {
+            return 1;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if (errno == EAGAIN)
+        {
+            return 0;
+        }
+        perror("read");
+        return -1;
+    }
+}
+
+/**
+* @param command - NULL terminated argument list, the first element is the full path to the
+*   command as for do_exec
+* @param callback - Called with each chunk of standard out (stream STDOUT_FILENO) and standard
+*   error (stream STDERR_FILENO) of the command as it arrives.  Returning false stops reading,
+*   the command then sees a closed pipe on its next write.
+* @param context - Passed to @param callback
+* @return true if the command was executed, all of its output was passed to @param callback and
+*   it exited with status 0.  false if the callback stopped reading or reading the output failed,
+*   whatever the exit status.
+*/
+bool do_exec_stream(char *const command[], exec_output_callback callback, void *context)
+{
+    struct start_options options = default_start_options;
+    struct pollfd fds[2];
+    int out_pipe[2] = { -1, -1 };
+    int err_pipe[2] = { -1, -1 };
+    int streams[2] = { STDOUT_FILENO, STDERR_FILENO };
+    int open_count = 2;
+    bool stopped = false;
+    bool success;
+    int result;
+    pid_t pid;
+    int i;
+
+    if ((pipe2(out_pipe, O_CLOEXEC) < 0) || (pipe2(err_pipe, O_CLOEXEC) < 0))
+    {
+        perror("pipe2");
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return false;
+    }
+    options.stdout_fd = out_pipe[1];
+    options.stderr_fd = err_pipe[1];
+    pid = start_command(command, &options);
+    // Only the child may hold the write ends, or we would never see end of file
+    close(out_pipe[1]);
+    close(err_pipe[1]);
     if (pid < 0)
     {
-        perror("fork");
+        close(out_pipe[0]);
+        close(err_pipe[0]);
         return false;
     }
-    else if (pid > 0)
+
+    fds[0].fd = out_pipe[0];
+    fds[1].fd = err_pipe[0];
+    for (i = 0; i < 2; i++)
+    {
+        fds[i].events = POLLIN;
+        fcntl(fds[i].fd, F_SETFL, O_NONBLOCK);
+    }
+    while (open_count > 0)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            stopped = true;
+            break;
+        }
+        for (i = 0; i < 2; i++)
+        {
+            if ((fds[i].fd < 0) || (fds[i].revents == 0))
+            {
+                continue;
+            }
+            result = stream_pipe(fds[i].fd, streams[i], callback, context);
+            if (result < 0)
+            {
+                // Stop reading both streams, they are closed below
+                stopped = true;
+                open_count = 0;
+                break;
+            }
+            if (result > 0)
+            {
+                // A negative fd is ignored by poll
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_count--;
+            }
+        }
+    }
+    for (i = 0; i < 2; i++)
     {
-        int status;
-        // Wait for a child proccess to complete
-        waitpid(pid, &status, 0);
-        close(fd);
-        if (WIFEXITED(status))
+        if (fds[i].fd >= 0)
         {
-            // Child process executed successfully
-            int ret_code = WEXITSTATUS(status); 
-            return ((ret_code == 0) ? true : false); 
+            close(fds[i].fd);
         }
-        else
+    }
+    // Reap the command even if its output was cut short
+    success = wait_command(pid, NULL, NULL);
+    return success && !stopped;
+}
+
+/**
+ * Append a chunk of output to the matching buffer of the struct exec_output @param context
+ */
+static bool capture_output(int stream, const char *data, size_t len, void *context)
+{
+    struct exec_output *output = context;
+    char **buf = (stream == STDOUT_FILENO) ? &output->stdout_data : &output->stderr_data;
+    size_t *buf_len = (stream == STDOUT_FILENO) ? &output->stdout_len : &output->stderr_len;
+    size_t *buf_size = (stream == STDOUT_FILENO) ? &output->stdout_size : &output->stderr_size;
+    size_t new_size;
+    char *new_buf;
+
+    // Grow geometrically, keeping room for the terminating NUL
+    if (*buf_len + len + 1 > *buf_size)
+    {
+        new_size = (*buf_size != 0) ? *buf_size : EXEC_CAPTURE_CHUNK_SIZE;
+        while (new_size < *buf_len + len + 1)
         {
-            // Child process did not terminate normally
+            new_size *= 2;
+        }
+        new_buf = realloc(*buf, new_size);
+        if (new_buf == NULL)
+        {
+            perror("realloc");
             return false;
         }
+        *buf = new_buf;
+        *buf_size = new_size;
     }
-    else
+    memcpy(&(*buf)[*buf_len], data, len);
+    *buf_len += len;
+    (*buf)[*buf_len] = '\0';
+    return true;
+}
+
+/**
+* @param command - See do_exec_stream
+* @param output - Filled with everything the command wrote to standard out and standard error,
+*   each NUL terminated.  Must be released with exec_output_free, even if this fails.
+* @return true if the command was executed and exited with status 0 and all of its output was
+*   captured.  false if it failed or the output is incomplete, see do_exec_stream.
+*/
+bool do_exec_capture(char *const command[], struct exec_output *output)
+{
+    memset(output, 0, sizeof(struct exec_output));
+    return do_exec_stream(command, capture_output, output);
+}
+
+/**
+ * Release the buffers of @param output filled by do_exec_capture
+ */
+void exec_output_free(struct exec_output *output)
+{
+    free(output->stdout_data);
+    free(output->stderr_data);
+    memset(output, 0, sizeof(struct exec_output));
+}
+
+static uint64_t min_u64(uint64_t a, uint64_t b)
+{
+    return (a < b) ? a : b;
+}
+
+/**
+ * Wait up to @param timeout_ms for the child @param pid to exit, polling @param pidfd if it is
+ * valid.
+ * @return true if it exited, false if the timeout expired first
+ */
+static bool wait_command_exit(pid_t pid, int pidfd, unsigned int timeout_ms)
+{
+    uint64_t deadline_ns = monotonic_ns() + (uint64_t)timeout_ms * 1000000;
+    struct timespec delay = { .tv_sec = 0, .tv_nsec = 1000000 };
+    struct pollfd fd = { .fd = pidfd, .events = POLLIN };
+    siginfo_t info;
+    uint64_t now_ns;
+    int result;
+
+    for (;;)
     {
-        if (dup2(fd, 1) < 0) 
-        { 
-            perror("dup2");
-            abort();
+        now_ns = monotonic_ns();
+        if (now_ns >= deadline_ns)
+        {
             return false;
         }
-        close(fd);
+        if (pidfd >= 0)
+        {
+            result = poll(&fd, 1, min_u64((deadline_ns - now_ns + 999999) / 1000000, INT_MAX));
+            if (result > 0)
+            {
+                return true;
+            }
+            if ((result < 0) && (errno != EINTR))
+            {
+                perror("poll");
+                return true; // Wait without a timeout rather than kill the child
+            }
+            continue;
+        }
+        // Without pidfds, check on the child every millisecond, leaving it to be reaped by wait4
+        memset(&info, 0, sizeof(info));
+        if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("waitid");
+            return true;
+        }
+        if (info.si_pid == pid)
+        {
+            return true;
+        }
+        nanosleep(&delay, NULL);
+    }
+}
+
+/**
+* @param command - NULL terminated argument list, the first element is the full path to the
+*   command as for do_exec
+* @param limits - Timeout, resource limits and cgroup for the command, NULL for none
+* @param report - If not NULL, filled with the wait status, timing and resource usage of the command
+* @return true if the command was executed, finished within its timeout and exited with status 0
+*/
+bool do_exec_limited(char *const command[], const struct exec_limits *limits, struct exec_report *report)
+{
+    struct start_options options = default_start_options;
+    struct exec_report local_report;
+    char cgroup_procs[PATH_MAX];
+    uint64_t start_ns;
+    int pidfd = -1;
+    pid_t pid;
+
+    if (report == NULL)
+    {
+        report = &local_report;
+    }
+    memset(report, 0, sizeof(struct exec_report));
+    report->status = -1;
+
+    if (limits != NULL)
+    {
+        options.rlimits = limits->rlimits;
+        options.rlimit_count = limits->rlimit_count;
+        if (limits->cgroup != NULL)
+        {
+            snprintf(cgroup_procs, sizeof(cgroup_procs), "%s/cgroup.procs", limits->cgroup);
+            options.cgroup_procs_fd = open(cgroup_procs, O_WRONLY | O_CLOEXEC);
+            if (options.cgroup_procs_fd < 0)
+            {
+                perror(cgroup_procs);
+                return false;
+            }
+        }
+    }
+
+    start_ns = monotonic_ns();
+    pid = start_command(command, &options);
+    if (options.cgroup_procs_fd >= 0)
+    {
+        close(options.cgroup_procs_fd);
+    }
+    if (pid < 0)
+    {
+        return false;
+    }
 
-        // Execute the command and store it in the interger
-        int ret_code = execv(command[0], command);
-        perror("execv");
-        exit(ret_code);
+    if ((limits != NULL) && (limits->timeout_ms != 0))
+    {
+        pidfd = syscall(SYS_pidfd_open, pid, 0);
+        if (!wait_command_exit(pid, pidfd, limits->timeout_ms))
+        {
+            kill(pid, SIGKILL);
+            report->timed_out = true;
+        }
+        if (pidfd >= 0)
+        {
+            close(pidfd);
+        }
     }
-    va_end(args);
 
-    return true;
+    report->success = wait_command(pid, &report->status, &report->usage) && !report->timed_out;
+    report->elapsed_ns = monotonic_ns() - start_ns;
+    return report->success;
 }
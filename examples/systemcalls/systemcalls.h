@@ -1,9 +1,137 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/resource.h>
+
+/**
+ * How do_exec and do_exec_redirect start commands
+ */
+enum exec_method
+{
+    /**
+     * posix_spawn, which starts the child without copying the caller's address space.
+     * The default.
+     */
+    EXEC_METHOD_SPAWN,
+    /**
+     * fork followed by execv in the child
+     */
+    EXEC_METHOD_FORK,
+};
+
+void set_exec_method(enum exec_method method);
+
+enum exec_method get_exec_method(void);
 
 bool do_system(const char *command);
 
 bool do_exec(int count, ...);
 
 bool do_exec_redirect(const char *outputfile, int count, ...);
+
+/**
+ * Outcome of one command run by do_exec_batch
+ */
+struct exec_result
+{
+    /**
+     * Wait status of the command, see waitpid(2), or -1 if it could not be started
+     */
+    int status;
+    /**
+     * True if the command exited with status 0
+     */
+    bool success;
+    /**
+     * Time from starting the command until it was reaped
+     */
+    uint64_t elapsed_ns;
+    /**
+     * CPU time, maximum RSS, page faults and so on used by the command, see getrusage(2)
+     */
+    struct rusage usage;
+};
+
+bool do_exec_batch(char *const *const commands[], size_t count, unsigned int max_parallel,
+                   struct exec_result results[]);
+
+/**
+ * Size of the reads do_exec_stream passes to its callback, and the initial size of the buffers
+ * filled by do_exec_capture
+ */
+#define EXEC_CAPTURE_CHUNK_SIZE 65536
+
+/**
+ * Receives output streamed by do_exec_stream.  @param stream is STDOUT_FILENO or STDERR_FILENO.
+ * @return false to stop reading the command's output
+ */
+typedef bool (*exec_output_callback)(int stream, const char *data, size_t len, void *context);
+
+bool do_exec_stream(char *const command[], exec_output_callback callback, void *context);
+
+/**
+ * Output of a command captured by do_exec_capture
+ */
+struct exec_output
+{
+    char *stdout_data;
+    size_t stdout_len;
+    size_t stdout_size;
+    char *stderr_data;
+    size_t stderr_len;
+    size_t stderr_size;
+};
+
+bool do_exec_capture(char *const command[], struct exec_output *output);
+
+void exec_output_free(struct exec_output *output);
+
+/**
+ * A resource limit for do_exec_limited, see setrlimit(2)
+ */
+struct exec_rlimit
+{
+    int resource;
+    struct rlimit limit;
+};
+
+/**
+ * Constraints on a command run by do_exec_limited.  Commands with rlimits or a cgroup are started
+ * with fork + execv whatever the exec method, posix_spawn has no way to apply them before the
+ * command runs.
+ */
+struct exec_limits
+{
+    /**
+     * Wall clock time after which the command is killed with SIGKILL, 0 for no limit
+     */
+    unsigned int timeout_ms;
+    const struct exec_rlimit *rlimits;
+    size_t rlimit_count;
+    /**
+     * Path of a cgroup v2 directory to run the command in, NULL to stay in ours
+     */
+    const char *cgroup;
+};
+
+/**
+ * Outcome of a command run by do_exec_limited
+ */
+struct exec_report
+{
+    /**
+     * Wait status of the command, see waitpid(2), or -1 if it could not be started
+     */
+    int status;
+    bool success;
+    /**
+     * True if the command was killed for exceeding exec_limits.timeout_ms
+     */
+    bool timed_out;
+    uint64_t elapsed_ns;
+    struct rusage usage;
+};
+
+bool do_exec_limited(char *const command[], const struct exec_limits *limits, struct exec_report *report);
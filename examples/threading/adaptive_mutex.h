@@ -0,0 +1,112 @@
+/*
+ * adaptive_mutex.h
+ *
+ *  @brief Mutex for short critical sections which spins a bounded number of times before
+ *  sleeping on a futex.  A drop-in for a default pthread_mutex_t: the functions take the same
+ *  arguments and return 0 or an error number like their pthread_mutex_* counterparts.
+ *
+ *  An uncontended lock and unlock are one atomic operation each and never enter the kernel.
+ *  A contended lock first spins ADAPTIVE_MUTEX_SPINS times, so a critical section which ends
+ *  within that window is handed over without a futex wait and wake.  Linux only.
+ */
+
+#ifndef ADAPTIVE_MUTEX_H
+#define ADAPTIVE_MUTEX_H
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#ifndef ADAPTIVE_MUTEX_SPINS
+#define ADAPTIVE_MUTEX_SPINS 100
+#endif
+
+/**
+ * The state is 0 when unlocked, 1 when locked and 2 when locked with possible waiters
+ * sleeping on the futex, as in Ulrich Drepper's "Futexes Are Tricky"
+ */
+typedef struct {
+    atomic_int state;
+} adaptive_mutex_t;
+
+#define ADAPTIVE_MUTEX_INITIALIZER { 0 }
+
+/**
+* Tell the CPU this is a spin-wait loop, so it can yield to a sibling hyperthread and avoid
+* a memory order violation stall when the loop exits
+*/
+static inline void adaptive_mutex_pause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static inline void adaptive_mutex_futex_wait(atomic_int *futex, int value)
+{
+    syscall(SYS_futex, futex, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static inline void adaptive_mutex_futex_wake(atomic_int *futex, int count)
+{
+    syscall(SYS_futex, futex, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static inline int adaptive_mutex_init(adaptive_mutex_t *mutex)
+{
+    atomic_init(&mutex->state, 0);
+    return 0;
+}
+
+static inline int adaptive_mutex_destroy(adaptive_mutex_t *mutex)
+{
+    (void)mutex;
+    return 0;
+}
+
+/**
+* @return 0 if @param mutex was acquired, EBUSY if it is held
+*/
+static inline int adaptive_mutex_trylock(adaptive_mutex_t *mutex)
+{
+    int expected = 0;
+
+    return atomic_compare_exchange_strong_explicit(&mutex->state, &expected, 1, memory_order_acquire,
+            memory_order_relaxed) ? 0 : EBUSY;
+}
+
+static inline int adaptive_mutex_lock(adaptive_mutex_t *mutex)
+{
+    int state;
+    int spins;
+
+    for (spins = 0; spins < ADAPTIVE_MUTEX_SPINS; spins++) {
+        state = atomic_load_explicit(&mutex->state, memory_order_relaxed);
+        if ((state == 0) && (adaptive_mutex_trylock(mutex) == 0)) {
+            return 0;
+        }
+        if (state == 2) {
+            // Others are already asleep waiting for it, queue behind them rather than spin
+            break;
+        }
+        adaptive_mutex_pause();
+    }
+    while (atomic_exchange_explicit(&mutex->state, 2, memory_order_acquire) != 0) {
+        adaptive_mutex_futex_wait(&mutex->state, 2);
+    }
+    return 0;
+}
+
+static inline int adaptive_mutex_unlock(adaptive_mutex_t *mutex)
+{
+    if (atomic_exchange_explicit(&mutex->state, 0, memory_order_release) == 2) {
+        adaptive_mutex_futex_wake(&mutex->state, 1);
+    }
+    return 0;
+}
+
+#endif /* ADAPTIVE_MUTEX_H */
@@ -0,0 +1,232 @@
+/**
+ * @file lockprof-bench.c
+ * @brief Compares the lock kinds of lockprof.h under the threadfunc workload
+ *
+ * For every combination of lock kind, thread count, wait_to_obtain_ms and wait_to_release_ms,
+ * each thread repeatedly waits wait_to_obtain_ms, obtains the lock, increments a shared counter,
+ * waits wait_to_release_ms and releases the lock, as threadfunc does once.  One line of results is
+ * printed per combination.  A wait of 0 measures the lock itself with an empty critical section.
+ *
+ * Usage: lockprof-bench [-k kind,...] [-t threads,...] [-o obtain ms,...] [-r release ms,...]
+ *                       [-i iterations] [-v]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "lockprof.h"
+
+#define MAX_SWEEP          16
+#define DEFAULT_ITERATIONS 100000
+
+struct sweep {
+    int values[MAX_SWEEP];
+    int count;
+};
+
+struct bench_config {
+    struct lockprof_mutex mutex;
+    int wait_to_obtain_ms;
+    int wait_to_release_ms;
+    int iterations;
+    /**
+     * Only modified with mutex held, checks the lock provides mutual exclusion
+     */
+    unsigned long counter;
+};
+
+static void* bench_thread(void* thread_param)
+{
+    struct bench_config *config = thread_param;
+    int i;
+
+    for (i = 0; i < config->iterations; i++) {
+        if (config->wait_to_obtain_ms > 0) {
+            usleep(config->wait_to_obtain_ms * 1000);
+        }
+        lockprof_mutex_lock(&config->mutex);
+        config->counter++;
+        if (config->wait_to_release_ms > 0) {
+            usleep(config->wait_to_release_ms * 1000);
+        }
+        lockprof_mutex_unlock(&config->mutex);
+    }
+    return NULL;
+}
+
+/**
+ * Parse the comma separated list @param arg into @param sweep
+ * @return false if @param arg is not a list of at most MAX_SWEEP non-negative integers
+ */
+static bool parse_sweep(const char *arg, struct sweep *sweep)
+{
+    char *end;
+    long value;
+
+    sweep->count = 0;
+    do {
+        value = strtol(arg, &end, 0);
+        if ((end == arg) || (value < 0) || (sweep->count == MAX_SWEEP)) {
+            return false;
+        }
+        sweep->values[sweep->count++] = value;
+        arg = end + 1;
+    } while (*end == ',');
+    return *end == '\0';
+}
+
+/**
+ * Parse the comma separated list of lock kind names @param arg into @param kinds
+ * @return false if a name is not a lock kind
+ */
+static bool parse_kinds(char *arg, bool kinds[LOCKPROF_KIND_COUNT])
+{
+    enum lockprof_kind kind;
+    char *name;
+
+    memset(kinds, 0, sizeof(bool) * LOCKPROF_KIND_COUNT);
+    for (name = strtok(arg, ","); name != NULL; name = strtok(NULL, ",")) {
+        kind = lockprof_kind_from_name(name);
+        if (kind == LOCKPROF_KIND_COUNT) {
+            return false;
+        }
+        kinds[kind] = true;
+    }
+    return true;
+}
+
+/**
+ * Run one combination of the sweep and print its results
+ * @return false if the lock did not provide mutual exclusion
+ */
+static bool run(enum lockprof_kind kind, int threads, int wait_to_obtain_ms, int wait_to_release_ms,
+            int iterations, bool verbose)
+{
+    pthread_t thread[threads];
+    struct bench_config config = {
+        .wait_to_obtain_ms = wait_to_obtain_ms,
+        .wait_to_release_ms = wait_to_release_ms,
+        .iterations = iterations,
+    };
+    const struct lockprof_stats *stats = &config.mutex.stats;
+    unsigned long expected;
+    struct timespec start, end;
+    double seconds;
+    int started;
+    int i;
+
+    if (lockprof_mutex_init(&config.mutex, "bench", kind) != 0) {
+        fprintf(stderr, "ERROR: Failed to initialize %s lock\n", lockprof_kind_name(kind));
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (started = 0; started < threads; started++) {
+        if (pthread_create(&thread[started], NULL, bench_thread, &config) != 0) {
+            fprintf(stderr, "ERROR: Failed to create thread\n");
+            break;
+        }
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(thread[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    expected = (unsigned long)started * iterations;
+
+    printf("%-8s %7d %6d %7d %12.0f %9.1f %10.2f %10.2f %10.2f\n", lockprof_kind_name(kind),
+            threads, wait_to_obtain_ms, wait_to_release_ms, stats->acquisitions / seconds,
+            100.0 * stats->contended / stats->acquisitions,
+            stats->wait_ns_total / 1e3 / stats->acquisitions, stats->wait_ns_max / 1e3,
+            stats->hold_ns_total / 1e3 / stats->acquisitions);
+    if (verbose) {
+        lockprof_dump(stdout);
+    }
+    lockprof_mutex_destroy(&config.mutex);
+
+    if ((started != threads) || (config.counter != expected)) {
+        fprintf(stderr, "ERROR: %s lock counted %lu of %lu increments\n", lockprof_kind_name(kind),
+                config.counter, expected);
+        return false;
+    }
+    return true;
+}
+
+static int usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-k kind,...] [-t threads,...] [-o obtain ms,...] [-r release ms,...] "
+            "[-i iterations] [-v]\n", name);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    bool kinds[LOCKPROF_KIND_COUNT];
+    struct sweep threads = { .values = { 1, 2, 4, 8 }, .count = 4 };
+    struct sweep obtain = { .values = { 0 }, .count = 1 };
+    struct sweep release = { .values = { 0 }, .count = 1 };
+    int iterations = DEFAULT_ITERATIONS;
+    bool verbose = false;
+    bool success = true;
+    enum lockprof_kind kind;
+    int t, o, r;
+    int opt;
+
+    for (kind = 0; kind < LOCKPROF_KIND_COUNT; kind++) {
+        kinds[kind] = true;
+    }
+    while ((opt = getopt(argc, argv, "k:t:o:r:i:v")) != -1) {
+        switch (opt) {
+        case 'k':
+            if (!parse_kinds(optarg, kinds)) {
+                return usage(argv[0]);
+            }
+            break;
+        case 't':
+            if (!parse_sweep(optarg, &threads)) {
+                return usage(argv[0]);
+            }
+            break;
+        case 'o':
+            if (!parse_sweep(optarg, &obtain)) {
+                return usage(argv[0]);
+            }
+            break;
+        case 'r':
+            if (!parse_sweep(optarg, &release)) {
+                return usage(argv[0]);
+            }
+            break;
+        case 'i': iterations = atoi(optarg); break;
+        case 'v': verbose = true; break;
+        default: return usage(argv[0]);
+        }
+    }
+    for (t = 0; t < threads.count; t++) {
+        if (threads.values[t] == 0) {
+            return usage(argv[0]);
+        }
+    }
+    if (iterations <= 0) {
+        return usage(argv[0]);
+    }
+
+    printf("%-8s %7s %6s %7s %12s %9s %10s %10s %10s\n", "lock", "threads", "obtain", "release",
+            "acquires/s", "contended", "wait avg", "wait max", "hold avg");
+    printf("%-8s %7s %6s %7s %12s %9s %10s %10s %10s\n", "", "", "ms", "ms", "", "%", "us", "us", "us");
+    for (kind = 0; kind < LOCKPROF_KIND_COUNT; kind++) {
+        if (!kinds[kind]) {
+            continue;
+        }
+        for (t = 0; t < threads.count; t++) {
+            for (o = 0; o < obtain.count; o++) {
+                for (r = 0; r < release.count; r++) {
+                    success &= run(kind, threads.values[t], obtain.values[o], release.values[r],
+                            iterations, verbose);
+                }
+            }
+        }
+    }
+    return success ? 0 : 1;
+}
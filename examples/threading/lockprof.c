@@ -0,0 +1,284 @@
+#define _GNU_SOURCE // PTHREAD_MUTEX_ADAPTIVE_NP
+#include "lockprof.h"
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Spins of the spinlock and ticket lock before yielding the CPU, so a waiter does not burn its
+ * whole time slice when the owner has been preempted
+ */
+#define LOCKPROF_SPINS_BEFORE_YIELD 1000
+
+static const char *lockprof_kind_names[LOCKPROF_KIND_COUNT] = {
+    [LOCKPROF_PTHREAD_MUTEX] = "mutex",
+    [LOCKPROF_PTHREAD_ADAPTIVE] = "adaptive",
+    [LOCKPROF_SPINLOCK] = "spin",
+    [LOCKPROF_TICKET] = "ticket",
+    [LOCKPROF_FUTEX] = "futex",
+    [LOCKPROF_ADAPTIVE_MUTEX] = "spinpark",
+};
+
+static struct lockprof_mutex *lockprof_list;
+static pthread_mutex_t lockprof_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool spin_trylock(atomic_int *spin)
+{
+    return !atomic_exchange_explicit(spin, 1, memory_order_acquire);
+}
+
+static void spin_lock(atomic_int *spin)
+{
+    unsigned int spins = 0;
+
+    while (!spin_trylock(spin)) {
+        // Wait for the lock to look free before writing to it again
+        while (atomic_load_explicit(spin, memory_order_relaxed)) {
+            if (++spins % LOCKPROF_SPINS_BEFORE_YIELD == 0) {
+                sched_yield();
+            }
+            adaptive_mutex_pause();
+        }
+    }
+}
+
+static bool ticket_trylock(struct lockprof_mutex *mutex)
+{
+    unsigned int serving = atomic_load_explicit(&mutex->lock.ticket.serving, memory_order_relaxed);
+    unsigned int next = serving;
+
+    return atomic_compare_exchange_strong_explicit(&mutex->lock.ticket.next, &next, serving + 1,
+            memory_order_acquire, memory_order_relaxed);
+}
+
+static void ticket_lock(struct lockprof_mutex *mutex)
+{
+    unsigned int ticket = atomic_fetch_add_explicit(&mutex->lock.ticket.next, 1, memory_order_relaxed);
+    unsigned int spins = 0;
+
+    while (atomic_load_explicit(&mutex->lock.ticket.serving, memory_order_acquire) != ticket) {
+        if (++spins % LOCKPROF_SPINS_BEFORE_YIELD == 0) {
+            sched_yield();
+        }
+        adaptive_mutex_pause();
+    }
+}
+
+/*
+ * The futex word is 0 when unlocked, 1 when locked and 2 when locked with possible waiters,
+ * as in Ulrich Drepper's "Futexes Are Tricky"
+ */
+static bool futex_trylock(atomic_int *futex)
+{
+    int expected = 0;
+
+    return atomic_compare_exchange_strong_explicit(futex, &expected, 1, memory_order_acquire,
+            memory_order_relaxed);
+}
+
+static void futex_lock(atomic_int *futex)
+{
+    while (atomic_exchange_explicit(futex, 2, memory_order_acquire) != 0) {
+        adaptive_mutex_futex_wait(futex, 2);
+    }
+}
+
+static void futex_unlock(atomic_int *futex)
+{
+    if (atomic_exchange_explicit(futex, 0, memory_order_release) == 2) {
+        adaptive_mutex_futex_wake(futex, 1);
+    }
+}
+
+const char *lockprof_kind_name(enum lockprof_kind kind)
+{
+    return (kind < LOCKPROF_KIND_COUNT) ? lockprof_kind_names[kind] : "unknown";
+}
+
+enum lockprof_kind lockprof_kind_from_name(const char *name)
+{
+    enum lockprof_kind kind;
+
+    for (kind = 0; kind < LOCKPROF_KIND_COUNT; kind++) {
+        if (strcmp(name, lockprof_kind_names[kind]) == 0) {
+            break;
+        }
+    }
+    return kind;
+}
+
+int lockprof_mutex_init(struct lockprof_mutex *mutex, const char *name, enum lockprof_kind kind)
+{
+    pthread_mutexattr_t attr;
+    int rc = 0;
+
+    memset(mutex, 0, sizeof(struct lockprof_mutex));
+    mutex->name = name;
+    mutex->kind = kind;
+    switch (kind) {
+    case LOCKPROF_PTHREAD_MUTEX:
+        rc = pthread_mutex_init(&mutex->lock.mutex, NULL);
+        break;
+    case LOCKPROF_PTHREAD_ADAPTIVE:
+        pthread_mutexattr_init(&attr);
+#ifdef PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+#endif
+        rc = pthread_mutex_init(&mutex->lock.mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        break;
+    case LOCKPROF_SPINLOCK:
+    case LOCKPROF_TICKET:
+    case LOCKPROF_FUTEX:
+        // All zero is unlocked
+        break;
+    case LOCKPROF_ADAPTIVE_MUTEX:
+        rc = adaptive_mutex_init(&mutex->lock.adaptive);
+        break;
+    default:
+        return EINVAL;
+    }
+    if (rc != 0) {
+        return rc;
+    }
+
+    pthread_mutex_lock(&lockprof_list_mutex);
+    mutex->next = lockprof_list;
+    lockprof_list = mutex;
+    pthread_mutex_unlock(&lockprof_list_mutex);
+    return 0;
+}
+
+void lockprof_mutex_destroy(struct lockprof_mutex *mutex)
+{
+    struct lockprof_mutex **link;
+
+    pthread_mutex_lock(&lockprof_list_mutex);
+    for (link = &lockprof_list; *link != NULL; link = &(*link)->next) {
+        if (*link == mutex) {
+            *link = mutex->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lockprof_list_mutex);
+
+    if ((mutex->kind == LOCKPROF_PTHREAD_MUTEX) || (mutex->kind == LOCKPROF_PTHREAD_ADAPTIVE)) {
+        pthread_mutex_destroy(&mutex->lock.mutex);
+    }
+}
+
+void lockprof_mutex_lock(struct lockprof_mutex *mutex)
+{
+    uint64_t start_ns = monotonic_ns();
+    uint64_t wait_ns;
+    bool acquired;
+
+    // Try once first, so acquisitions which had to wait can be counted as contended
+    switch (mutex->kind) {
+    case LOCKPROF_PTHREAD_MUTEX:
+    case LOCKPROF_PTHREAD_ADAPTIVE:
+        acquired = (pthread_mutex_trylock(&mutex->lock.mutex) == 0);
+        if (!acquired) {
+            pthread_mutex_lock(&mutex->lock.mutex);
+        }
+        break;
+    case LOCKPROF_SPINLOCK:
+        acquired = spin_trylock(&mutex->lock.spin);
+        if (!acquired) {
+            spin_lock(&mutex->lock.spin);
+        }
+        break;
+    case LOCKPROF_TICKET:
+        acquired = ticket_trylock(mutex);
+        if (!acquired) {
+            ticket_lock(mutex);
+        }
+        break;
+    case LOCKPROF_ADAPTIVE_MUTEX:
+        acquired = (adaptive_mutex_trylock(&mutex->lock.adaptive) == 0);
+        if (!acquired) {
+            adaptive_mutex_lock(&mutex->lock.adaptive);
+        }
+        break;
+    case LOCKPROF_FUTEX:
+    default:
+        acquired = futex_trylock(&mutex->lock.futex);
+        if (!acquired) {
+            futex_lock(&mutex->lock.futex);
+        }
+        break;
+    }
+
+    mutex->acquired_ns = monotonic_ns();
+    wait_ns = mutex->acquired_ns - start_ns;
+    mutex->stats.acquisitions++;
+    if (!acquired) {
+        mutex->stats.contended++;
+    }
+    mutex->stats.wait_ns_total += wait_ns;
+    if (wait_ns > mutex->stats.wait_ns_max) {
+        mutex->stats.wait_ns_max = wait_ns;
+    }
+}
+
+void lockprof_mutex_unlock(struct lockprof_mutex *mutex)
+{
+    uint64_t hold_ns = monotonic_ns() - mutex->acquired_ns;
+
+    mutex->stats.hold_ns_total += hold_ns;
+    if (hold_ns > mutex->stats.hold_ns_max) {
+        mutex->stats.hold_ns_max = hold_ns;
+    }
+
+    switch (mutex->kind) {
+    case LOCKPROF_PTHREAD_MUTEX:
+    case LOCKPROF_PTHREAD_ADAPTIVE:
+        pthread_mutex_unlock(&mutex->lock.mutex);
+        break;
+    case LOCKPROF_SPINLOCK:
+        atomic_store_explicit(&mutex->lock.spin, 0, memory_order_release);
+        break;
+    case LOCKPROF_TICKET:
+        atomic_fetch_add_explicit(&mutex->lock.ticket.serving, 1, memory_order_release);
+        break;
+    case LOCKPROF_ADAPTIVE_MUTEX:
+        adaptive_mutex_unlock(&mutex->lock.adaptive);
+        break;
+    case LOCKPROF_FUTEX:
+    default:
+        futex_unlock(&mutex->lock.futex);
+        break;
+    }
+}
+
+void lockprof_mutex_dump(struct lockprof_mutex *mutex, FILE *stream)
+{
+    const struct lockprof_stats *stats = &mutex->stats;
+    unsigned long count = (stats->acquisitions != 0) ? stats->acquisitions : 1;
+
+    fprintf(stream, "%-16s %-8s acquisitions=%lu contended=%lu (%.1f%%) "
+            "wait avg=%.2fus max=%.2fus hold avg=%.2fus max=%.2fus\n",
+            mutex->name, lockprof_kind_name(mutex->kind), stats->acquisitions, stats->contended,
+            100.0 * stats->contended / count, stats->wait_ns_total / 1e3 / count,
+            stats->wait_ns_max / 1e3, stats->hold_ns_total / 1e3 / count, stats->hold_ns_max / 1e3);
+}
+
+void lockprof_dump(FILE *stream)
+{
+    struct lockprof_mutex *mutex;
+
+    pthread_mutex_lock(&lockprof_list_mutex);
+    for (mutex = lockprof_list; mutex != NULL; mutex = mutex->next) {
+        lockprof_mutex_dump(mutex, stream);
+    }
+    pthread_mutex_unlock(&lockprof_list_mutex);
+}
@@ -0,0 +1,118 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "adaptive_mutex.h"
+
+/**
+ * Lock implementations a lockprof_mutex can wrap
+ */
+enum lockprof_kind {
+    LOCKPROF_PTHREAD_MUTEX,
+    /**
+     * glibc PTHREAD_MUTEX_ADAPTIVE_NP, spins briefly before sleeping on a futex
+     */
+    LOCKPROF_PTHREAD_ADAPTIVE,
+    /**
+     * Test and test-and-set spinlock
+     */
+    LOCKPROF_SPINLOCK,
+    /**
+     * FIFO spinlock, waiters are served in the order they arrived
+     */
+    LOCKPROF_TICKET,
+    /**
+     * Three state futex mutex, sleeps in the kernel as soon as the lock is contended
+     */
+    LOCKPROF_FUTEX,
+    /**
+     * adaptive_mutex_t, the futex mutex after a bounded spin
+     */
+    LOCKPROF_ADAPTIVE_MUTEX,
+    LOCKPROF_KIND_COUNT
+};
+
+/**
+ * Contention statistics of one lockprof_mutex.  Updated while the lock is held, so they need no
+ * synchronization of their own, but should only be read once the threads using the lock are done.
+ */
+struct lockprof_stats {
+    unsigned long acquisitions;
+    /**
+     * Acquisitions which found the lock already held
+     */
+    unsigned long contended;
+    /**
+     * Time from requesting the lock to holding it
+     */
+    uint64_t wait_ns_total;
+    uint64_t wait_ns_max;
+    /**
+     * Time from holding the lock to releasing it
+     */
+    uint64_t hold_ns_total;
+    uint64_t hold_ns_max;
+};
+
+/**
+ * A lock of any lockprof_kind which records its contention statistics
+ */
+struct lockprof_mutex {
+    const char *name;
+    enum lockprof_kind kind;
+    union {
+        pthread_mutex_t mutex;
+        atomic_int spin;
+        struct {
+            atomic_uint next;
+            atomic_uint serving;
+        } ticket;
+        atomic_int futex;
+        adaptive_mutex_t adaptive;
+    } lock;
+    /**
+     * CLOCK_MONOTONIC time the current owner acquired the lock
+     */
+    uint64_t acquired_ns;
+    struct lockprof_stats stats;
+    /**
+     * Next lock in the list printed by lockprof_dump
+     */
+    struct lockprof_mutex *next;
+};
+
+/**
+* @return the name of @param kind as accepted by lockprof_kind_from_name
+*/
+const char *lockprof_kind_name(enum lockprof_kind kind);
+
+/**
+* @return the lockprof_kind called @param name, or LOCKPROF_KIND_COUNT if there is none
+*/
+enum lockprof_kind lockprof_kind_from_name(const char *name);
+
+/**
+* Initialize @param mutex as an unlocked lock of @param kind and add it to the list printed by
+* lockprof_dump under @param name.
+* @return 0 on success or an error number
+*/
+int lockprof_mutex_init(struct lockprof_mutex *mutex, const char *name, enum lockprof_kind kind);
+
+/**
+* Remove @param mutex from the list printed by lockprof_dump and release its resources
+*/
+void lockprof_mutex_destroy(struct lockprof_mutex *mutex);
+
+void lockprof_mutex_lock(struct lockprof_mutex *mutex);
+void lockprof_mutex_unlock(struct lockprof_mutex *mutex);
+
+/**
+* Print the statistics of @param mutex to @param stream on one line
+*/
+void lockprof_mutex_dump(struct lockprof_mutex *mutex, FILE *stream);
+
+/**
+* Print the statistics of every initialized lockprof_mutex to @param stream
+*/
+void lockprof_dump(FILE *stream);
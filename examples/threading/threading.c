@@ -2,6 +2,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
 
 // Optional: use these functions to add debug or error prints to your application
 #define DEBUG_LOG(msg,...)
@@ -58,3 +59,344 @@ bool start_thread_obtaining_mutex(pthread_t *thread, pthread_mutex_t *mutex,int
     return true;
 }
 
+/**
+ * A task whose mutex is held by another task of the pool waits for that task to release it.  One
+ * whose mutex is held outside the pool, where the release can't be seen, retries after
+ * THREAD_POOL_RETRY_MS, doubling the interval on each retry up to THREAD_POOL_RETRY_MAX_MS.
+ */
+#define THREAD_POOL_RETRY_MS     1
+#define THREAD_POOL_RETRY_MAX_MS 64
+
+static void timespec_add_ms(struct timespec *ts, int ms)
+{
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static bool timespec_before(const struct timespec *a, const struct timespec *b)
+{
+    return (a->tv_sec < b->tv_sec) || ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+}
+
+static void timer_heap_swap(struct thread_pool *pool, size_t a, size_t b)
+{
+    struct thread_pool_task *task = pool->timer_heap[a];
+
+    pool->timer_heap[a] = pool->timer_heap[b];
+    pool->timer_heap[b] = task;
+}
+
+/**
+ * Add @param task to the timer heap of @param pool.  Caller must hold pool->lock.
+ */
+static void timer_heap_push(struct thread_pool *pool, struct thread_pool_task *task)
+{
+    size_t index = pool->timer_count++;
+
+    pool->timer_heap[index] = task;
+    while ((index > 0) && timespec_before(&pool->timer_heap[index]->deadline,
+                                          &pool->timer_heap[(index - 1) / 2]->deadline)) {
+        timer_heap_swap(pool, index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+    if (index == 0) {
+        // New earliest deadline, the timer thread must recompute its wait
+        pthread_cond_signal(&pool->timer_cond);
+    }
+}
+
+/**
+ * Remove and return the task with the earliest deadline.  Caller must hold pool->lock.
+ */
+static struct thread_pool_task *timer_heap_pop(struct thread_pool *pool)
+{
+    struct thread_pool_task *task = pool->timer_heap[0];
+    size_t index = 0;
+    size_t child;
+
+    pool->timer_count--;
+    if (pool->timer_count > 0) {
+        timer_heap_swap(pool, 0, pool->timer_count);
+        for (;;) {
+            child = 2 * index + 1;
+            if (child >= pool->timer_count) {
+                break;
+            }
+            if ((child + 1 < pool->timer_count) &&
+                timespec_before(&pool->timer_heap[child + 1]->deadline, &pool->timer_heap[child]->deadline)) {
+                child++;
+            }
+            if (!timespec_before(&pool->timer_heap[child]->deadline, &pool->timer_heap[index]->deadline)) {
+                break;
+            }
+            timer_heap_swap(pool, index, child);
+            index = child;
+        }
+    }
+    return task;
+}
+
+/**
+ * Add @param task to the end of the ready queue of @param pool.  Caller must hold pool->lock.
+ */
+static void ready_queue_push(struct thread_pool *pool, struct thread_pool_task *task)
+{
+    task->next = NULL;
+    if (pool->ready_tail != NULL) {
+        pool->ready_tail->next = task;
+    }
+    else {
+        pool->ready_head = task;
+    }
+    pool->ready_tail = task;
+    pthread_cond_signal(&pool->work_cond);
+}
+
+/**
+ * Put aside @param task, whose mutex is held, until it may be free.  Caller must hold pool->lock.
+ */
+static void thread_pool_park(struct thread_pool *pool, struct thread_pool_task *task)
+{
+    struct thread_pool_task *holder;
+
+    for (holder = pool->running; holder != NULL; holder = holder->running_next) {
+        if (holder->data.mutex == task->data.mutex) {
+            // Requeued by thread_pool_release when the holder is done with the mutex
+            task->next = holder->waiters;
+            holder->waiters = task;
+            return;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &task->deadline);
+    timespec_add_ms(&task->deadline, task->retry_ms);
+    if (task->retry_ms < THREAD_POOL_RETRY_MAX_MS) {
+        task->retry_ms *= 2;
+    }
+    timer_heap_push(pool, task);
+}
+
+/**
+ * Remove @param task, which released its mutex, from the running tasks of @param pool and requeue
+ * the tasks waiting for the mutex.  Caller must hold pool->lock.
+ */
+static void thread_pool_release(struct thread_pool *pool, struct thread_pool_task *task)
+{
+    struct thread_pool_task **link = &pool->running;
+    struct thread_pool_task *waiter;
+
+    while (*link != task) {
+        link = &(*link)->running_next;
+    }
+    *link = task->running_next;
+    while (task->waiters != NULL) {
+        waiter = task->waiters;
+        task->waiters = waiter->next;
+        ready_queue_push(pool, waiter);
+    }
+}
+
+/**
+ * Moves tasks from the timer heap to the ready queue as their deadlines pass
+ */
+static void* thread_pool_timer(void* pool_param)
+{
+    struct thread_pool *pool = pool_param;
+    struct timespec now;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->shutdown) {
+        if (pool->timer_count == 0) {
+            pthread_cond_wait(&pool->timer_cond, &pool->lock);
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timespec_before(&now, &pool->timer_heap[0]->deadline)) {
+            pthread_cond_timedwait(&pool->timer_cond, &pool->lock, &pool->timer_heap[0]->deadline);
+            continue;
+        }
+        ready_queue_push(pool, timer_heap_pop(pool));
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * Runs ready tasks: takes the task's mutex, holds it for wait_to_release_ms and releases it
+ */
+static void* thread_pool_worker(void* pool_param)
+{
+    struct thread_pool *pool = pool_param;
+    struct thread_pool_task *task;
+    struct timespec release_time;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->shutdown) {
+        if (pool->ready_head == NULL) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+            continue;
+        }
+        task = pool->ready_head;
+        pool->ready_head = task->next;
+        if (pool->ready_head == NULL) {
+            pool->ready_tail = NULL;
+        }
+
+        // Don't tie up a worker waiting for a mutex which is held, try again later instead.  The
+        // mutex is tried under pool->lock so a task of the pool holding it is always found running.
+        if (pthread_mutex_trylock(task->data.mutex) != 0) {
+            thread_pool_park(pool, task);
+            continue;
+        }
+        task->running_next = pool->running;
+        pool->running = task;
+        pthread_mutex_unlock(&pool->lock);
+
+        // A pthread mutex must be released by its owner, so the worker waits out the hold time
+        clock_gettime(CLOCK_MONOTONIC, &release_time);
+        timespec_add_ms(&release_time, task->data.wait_to_release_ms);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &release_time, NULL) == EINTR) {
+        }
+        pthread_mutex_unlock(task->data.mutex);
+
+        pthread_mutex_lock(&pool->lock);
+        thread_pool_release(pool, task);
+        task->data.thread_complete_success = true;
+        task->done = true;
+        pthread_cond_broadcast(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct thread_pool *thread_pool_create(unsigned int worker_count, size_t max_tasks)
+{
+    struct thread_pool *pool;
+    pthread_condattr_t cond_attr;
+    size_t i;
+
+    if ((worker_count == 0) || (max_tasks == 0)) {
+        return NULL;
+    }
+    pool = calloc(1, sizeof(struct thread_pool));
+    if (pool == NULL) {
+        ERROR_LOG("Failed to allocate memory for thread_pool.");
+        return NULL;
+    }
+    pool->tasks = calloc(max_tasks, sizeof(struct thread_pool_task));
+    pool->timer_heap = calloc(max_tasks, sizeof(struct thread_pool_task *));
+    pool->workers = calloc(worker_count, sizeof(pthread_t));
+    if ((pool->tasks == NULL) || (pool->timer_heap == NULL) || (pool->workers == NULL)) {
+        ERROR_LOG("Failed to allocate memory for thread_pool tasks.");
+        free(pool->tasks);
+        free(pool->timer_heap);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    pool->max_tasks = max_tasks;
+    for (i = 0; i < max_tasks; i++) {
+        pool->tasks[i].pool = pool;
+        pool->tasks[i].next = (i + 1 < max_tasks) ? &pool->tasks[i + 1] : NULL;
+    }
+    pool->free_list = &pool->tasks[0];
+
+    // Task deadlines are CLOCK_MONOTONIC, immune to changes of the wall clock
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pool->timer_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    if (pthread_create(&pool->timer_thread, NULL, thread_pool_timer, pool) != 0) {
+        ERROR_LOG("Failed to create thread_pool timer thread.");
+        pool->worker_count = 0;
+        pool->shutdown = true;
+        thread_pool_destroy(pool);
+        return NULL;
+    }
+    for (pool->worker_count = 0; pool->worker_count < worker_count; pool->worker_count++) {
+        if (pthread_create(&pool->workers[pool->worker_count], NULL, thread_pool_worker, pool) != 0) {
+            ERROR_LOG("Failed to create thread_pool worker thread.");
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void thread_pool_destroy(struct thread_pool *pool)
+{
+    bool timer_started = !pool->shutdown;
+    unsigned int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_cond_broadcast(&pool->timer_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (timer_started) {
+        pthread_join(pool->timer_thread, NULL);
+    }
+    for (i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->timer_cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool->timer_heap);
+    free(pool->tasks);
+    free(pool);
+}
+
+struct thread_pool_task *thread_pool_start_obtaining_mutex(struct thread_pool *pool, pthread_mutex_t *mutex,
+        int wait_to_obtain_ms, int wait_to_release_ms)
+{
+    struct thread_pool_task *task;
+
+    pthread_mutex_lock(&pool->lock);
+    task = pool->free_list;
+    if (task == NULL) {
+        pthread_mutex_unlock(&pool->lock);
+        ERROR_LOG("No free thread_pool task slot.");
+        return NULL;
+    }
+    pool->free_list = task->next;
+
+    task->data.mutex = mutex;
+    task->data.wait_to_obtain_ms = wait_to_obtain_ms;
+    task->data.wait_to_release_ms = wait_to_release_ms;
+    task->data.thread_complete_success = false;
+    task->done = false;
+    task->retry_ms = THREAD_POOL_RETRY_MS;
+    task->waiters = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &task->deadline);
+    timespec_add_ms(&task->deadline, wait_to_obtain_ms);
+    timer_heap_push(pool, task);
+    pthread_mutex_unlock(&pool->lock);
+    return task;
+}
+
+bool thread_pool_join(struct thread_pool_task *task)
+{
+    struct thread_pool *pool = task->pool;
+    bool success;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!task->done) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    success = task->data.thread_complete_success;
+    task->next = pool->free_list;
+    pool->free_list = task;
+    pthread_mutex_unlock(&pool->lock);
+    return success;
+}
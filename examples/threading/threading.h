@@ -1,5 +1,7 @@
 #include <stdbool.h>
+#include <stddef.h>
 #include <pthread.h>
+#include <time.h>
 
 /**
  * This structure should be dynamically allocated and passed as
@@ -41,3 +43,93 @@ struct thread_data{
 * @return true if the thread could be started, false if a failure occurred.
 */
 bool start_thread_obtaining_mutex(pthread_t *thread, pthread_mutex_t *mutex,int wait_to_obtain_ms, int wait_to_release_ms);
+
+/**
+ * A thread_data task scheduled on a thread_pool by thread_pool_start_obtaining_mutex
+ */
+struct thread_pool_task
+{
+    struct thread_data data;
+    struct thread_pool *pool;
+    /**
+     * CLOCK_MONOTONIC time at which the task next becomes runnable
+     */
+    struct timespec deadline;
+    /**
+     * Delay before the next retry while the task's mutex is held outside the pool
+     */
+    int retry_ms;
+    bool done;
+    /**
+     * Next task in the pool's free list, ready queue or in the waiters of another task
+     */
+    struct thread_pool_task *next;
+    /**
+     * While the task holds its mutex, the next task holding a mutex and the tasks waiting for
+     * this one to release it
+     */
+    struct thread_pool_task *running_next;
+    struct thread_pool_task *waiters;
+};
+
+/**
+ * Runs delayed mutex tasks on a fixed set of worker threads.  Tasks come from slots allocated
+ * when the pool is created, and their delays are tracked by one timer thread rather than by a
+ * sleeping thread per task.
+ */
+struct thread_pool
+{
+    pthread_mutex_t lock;
+    /**
+     * Signalled when a task is added to the ready queue, the timer heap changes or the pool
+     * shuts down
+     */
+    pthread_cond_t work_cond;
+    pthread_cond_t timer_cond;
+    /**
+     * Broadcast when a task completes
+     */
+    pthread_cond_t done_cond;
+    struct thread_pool_task *tasks;
+    size_t max_tasks;
+    struct thread_pool_task *free_list;
+    struct thread_pool_task *ready_head;
+    struct thread_pool_task *ready_tail;
+    /**
+     * Min-heap of tasks waiting for their deadline
+     */
+    struct thread_pool_task **timer_heap;
+    size_t timer_count;
+    /**
+     * Tasks holding their mutex, linked through running_next
+     */
+    struct thread_pool_task *running;
+    pthread_t timer_thread;
+    pthread_t *workers;
+    unsigned int worker_count;
+    bool shutdown;
+};
+
+/**
+* Create a pool of @param worker_count threads able to hold @param max_tasks tasks at once.
+* @return the pool, or NULL if it could not be created
+*/
+struct thread_pool *thread_pool_create(unsigned int worker_count, size_t max_tasks);
+
+/**
+* Stop the threads of @param pool and free it.  Tasks which have not completed are abandoned.
+*/
+void thread_pool_destroy(struct thread_pool *pool);
+
+/**
+* Same as start_thread_obtaining_mutex, but run as a task on @param pool.
+* @return a handle to pass to thread_pool_join, or NULL if all task slots are in use
+*/
+struct thread_pool_task *thread_pool_start_obtaining_mutex(struct thread_pool *pool, pthread_mutex_t *mutex,
+        int wait_to_obtain_ms, int wait_to_release_ms);
+
+/**
+* Wait for @param task to complete and return its slot to the pool.
+* @return thread_complete_success of the task
+*/
+bool thread_pool_join(struct thread_pool_task *task);
@@ -0,0 +1,303 @@
+/*
+* Persistent index of the files seen by finder, see finder-index.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "finder-index.h"
+
+static uint64_t hash_path(const char *path){
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    while (*path != '\0') {
+        hash ^= (unsigned char)*path++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Read the whole file at path into a malloc()ed buffer
+static char *read_file(const char *path, size_t *size_rtn){
+    struct stat st;
+    char *data;
+    size_t done = 0;
+    ssize_t len;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1 || (data = malloc(st.st_size + 1)) == NULL) {
+        close(fd);
+        return NULL;
+    }
+    while (done < (size_t)st.st_size) {
+        len = read(fd, data + done, st.st_size - done);
+        if (len <= 0) {
+            if (len == -1 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += len;
+    }
+    close(fd);
+    *size_rtn = done;
+    return data;
+}
+
+// Parse the index in index->data, returns false if it is corrupt
+static bool parse_index(struct finder_index *index, size_t size){
+    struct finder_index_header header;
+    struct finder_index_file *file;
+    const char *pos = index->data;
+    const char *end = index->data + size;
+    uint32_t len;
+    size_t i;
+
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, pos, sizeof(header));
+    pos += sizeof(header);
+    if (header.magic != FINDER_INDEX_MAGIC || header.version != FINDER_INDEX_VERSION ||
+        header.search_count > FINDER_INDEX_SEARCHES ||
+        header.file_count > size / sizeof(struct finder_index_record)) {
+        return false;
+    }
+
+    for (i = 0; i < header.search_count; i++) {
+        if ((size_t)(end - pos) < sizeof(len)) {
+            return false;
+        }
+        memcpy(&len, pos, sizeof(len));
+        pos += sizeof(len);
+        if ((size_t)(end - pos) < len) {
+            return false;
+        }
+        index->searches[i] = pos;
+        index->search_lens[i] = len;
+        pos += len;
+    }
+    index->search_count = header.search_count;
+
+    index->files = calloc(header.file_count ? header.file_count : 1, sizeof(struct finder_index_file));
+    if (index->files == NULL) {
+        return false;
+    }
+    for (i = 0; i < header.file_count; i++) {
+        file = &index->files[i];
+        if ((size_t)(end - pos) < sizeof(struct finder_index_record) + header.search_count * sizeof(uint64_t)) {
+            return false;
+        }
+        memcpy(&file->record, pos, sizeof(struct finder_index_record));
+        pos += sizeof(struct finder_index_record);
+        memcpy(file->counts, pos, header.search_count * sizeof(uint64_t));
+        pos += header.search_count * sizeof(uint64_t);
+        len = file->record.path_len;
+        if (len == 0 || (size_t)(end - pos) < len || pos[len - 1] != '\0') {
+            return false;
+        }
+        file->path = pos;
+        pos += len;
+    }
+    index->file_count = header.file_count;
+    return pos == end;
+}
+
+static bool build_table(struct finder_index *index){
+    size_t buckets = 16;
+    size_t bucket;
+    size_t i;
+
+    while (buckets < index->file_count * 2) {
+        buckets *= 2;
+    }
+    index->table = calloc(buckets, sizeof(size_t));
+    if (index->table == NULL) {
+        return false;
+    }
+    index->table_mask = buckets - 1;
+    for (i = 0; i < index->file_count; i++) {
+        bucket = hash_path(index->files[i].path) & index->table_mask;
+        while (index->table[bucket] != 0) {
+            bucket = (bucket + 1) & index->table_mask;
+        }
+        index->table[bucket] = i + 1;
+    }
+    return true;
+}
+
+int finder_index_load(struct finder_index *index, const char *path){
+    size_t size = 0;
+
+    memset(index, 0, sizeof(struct finder_index));
+    index->data = read_file(path, &size);
+    if (index->data == NULL) {
+        if (errno != ENOENT) {
+            fprintf(stderr, "finder: ignoring index %s: %s\n", path, strerror(errno));
+        }
+    }
+    else if (!parse_index(index, size)) {
+        fprintf(stderr, "finder: ignoring corrupt index %s\n", path);
+        finder_index_free(index);
+    }
+    return build_table(index) ? 0 : -1;
+}
+
+void finder_index_free(struct finder_index *index){
+    free(index->table);
+    free(index->files);
+    free(index->data);
+    memset(index, 0, sizeof(struct finder_index));
+}
+
+int finder_index_search_slot(const struct finder_index *index, const char *search, size_t search_len){
+    unsigned int i;
+
+    for (i = 0; i < index->search_count; i++) {
+        if (index->search_lens[i] == search_len && memcmp(index->searches[i], search, search_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const struct finder_index_file *finder_index_lookup(const struct finder_index *index, const char *path){
+    size_t bucket = hash_path(path) & index->table_mask;
+    const struct finder_index_file *file;
+
+    while (index->table[bucket] != 0) {
+        file = &index->files[index->table[bucket] - 1];
+        if (strcmp(file->path, path) == 0) {
+            return file;
+        }
+        bucket = (bucket + 1) & index->table_mask;
+    }
+    return NULL;
+}
+
+void finder_index_record_from_stat(struct finder_index_record *record, const struct stat *st){
+    memset(record, 0, sizeof(struct finder_index_record));
+    record->dev = st->st_dev;
+    record->ino = st->st_ino;
+    record->size = st->st_size;
+    record->mtime_sec = st->st_mtim.tv_sec;
+    record->mtime_nsec = st->st_mtim.tv_nsec;
+    record->ctime_sec = st->st_ctim.tv_sec;
+    record->ctime_nsec = st->st_ctim.tv_nsec;
+}
+
+bool finder_index_record_matches(const struct finder_index_record *record, const struct stat *st){
+    return record->dev == (uint64_t)st->st_dev && record->ino == (uint64_t)st->st_ino &&
+           record->size == (uint64_t)st->st_size && record->mtime_sec == st->st_mtim.tv_sec &&
+           record->mtime_nsec == st->st_mtim.tv_nsec && record->ctime_sec == st->st_ctim.tv_sec &&
+           record->ctime_nsec == st->st_ctim.tv_nsec;
+}
+
+bool finder_index_list_add(struct finder_index_list *list, const struct finder_index_file *file){
+    struct finder_index_file *files;
+    size_t capacity;
+    char *path;
+
+    if (list->count == list->capacity) {
+        capacity = list->capacity ? list->capacity * 2 : 256;
+        files = realloc(list->files, capacity * sizeof(struct finder_index_file));
+        if (files == NULL) {
+            return false;
+        }
+        list->files = files;
+        list->capacity = capacity;
+    }
+    path = strdup(file->path);
+    if (path == NULL) {
+        return false;
+    }
+    list->files[list->count] = *file;
+    list->files[list->count].path = path;
+    list->files[list->count].record.path_len = strlen(path) + 1;
+    list->count++;
+    return true;
+}
+
+void finder_index_list_free(struct finder_index_list *list){
+    size_t i;
+
+    for (i = 0; i < list->count; i++) {
+        free((char *)list->files[i].path);
+    }
+    free(list->files);
+    memset(list, 0, sizeof(struct finder_index_list));
+}
+
+int finder_index_save(const char *path, const char *const *searches, const size_t *search_lens,
+        unsigned int search_count, const struct finder_index_list *lists, unsigned int list_count){
+    struct finder_index_header header = {
+        .magic = FINDER_INDEX_MAGIC,
+        .version = FINDER_INDEX_VERSION,
+        .search_count = search_count,
+    };
+    const struct finder_index_file *file;
+    char *tmp_path;
+    uint32_t len;
+    unsigned int i;
+    size_t j;
+    FILE *out;
+    int saved_errno;
+
+    for (i = 0; i < list_count; i++) {
+        header.file_count += lists[i].count;
+    }
+
+    // Written beside the index and renamed over it, so readers never see a partial index
+    tmp_path = malloc(strlen(path) + 32);
+    if (tmp_path == NULL) {
+        return -1;
+    }
+    sprintf(tmp_path, "%s.tmp.%ld", path, (long)getpid());
+    out = fopen(tmp_path, "we");
+    if (out == NULL) {
+        free(tmp_path);
+        return -1;
+    }
+
+    fwrite(&header, sizeof(header), 1, out);
+    for (i = 0; i < search_count; i++) {
+        len = search_lens[i];
+        fwrite(&len, sizeof(len), 1, out);
+        fwrite(searches[i], 1, len, out);
+    }
+    for (i = 0; i < list_count; i++) {
+        for (j = 0; j < lists[i].count; j++) {
+            file = &lists[i].files[j];
+            fwrite(&file->record, sizeof(struct finder_index_record), 1, out);
+            fwrite(file->counts, sizeof(uint64_t), search_count, out);
+            fwrite(file->path, 1, file->record.path_len, out);
+        }
+    }
+
+    if (fflush(out) != 0 || ferror(out) || fsync(fileno(out)) != 0) {
+        saved_errno = errno;
+        fclose(out);
+        unlink(tmp_path);
+        free(tmp_path);
+        errno = saved_errno;
+        return -1;
+    }
+    fclose(out);
+    if (rename(tmp_path, path) != 0) {
+        saved_errno = errno;
+        unlink(tmp_path);
+        free(tmp_path);
+        errno = saved_errno;
+        return -1;
+    }
+    free(tmp_path);
+    return 0;
+}
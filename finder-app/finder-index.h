@@ -0,0 +1,121 @@
+/*
+* Persistent index of the files seen by finder and their match counts
+*
+* The index remembers, for every regular file of a previous run, its device, inode, size,
+* modification time and status change time together with its number of matching lines for each
+* of the last FINDER_INDEX_SEARCHES search strings.  A file whose stat() still matches its record
+* does not need to be read again for a search string the index has a count for.  The change time
+* catches a file rewritten at the same size whose modification time was then restored, as by
+* touch -r, rsync -t or tar.
+*
+* The file is a struct finder_index_header, then search_count search strings each as a uint32_t
+* length followed by the bytes, most recent first, then file_count records each a
+* struct finder_index_record, search_count uint64_t counts and path_len bytes of path including
+* its terminating NUL.  Fields are in the byte order of the machine which wrote the index.
+*/
+
+#ifndef FINDER_INDEX_H
+#define FINDER_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define FINDER_INDEX_MAGIC    0x58444e46  /* "FNDX" */
+#define FINDER_INDEX_VERSION  2
+#define FINDER_INDEX_SEARCHES 8
+// Count of a search string which was not run on the file since it last changed
+#define FINDER_INDEX_UNKNOWN  UINT64_MAX
+
+struct finder_index_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t search_count;
+    uint32_t reserved;
+    uint64_t file_count;
+};
+
+struct finder_index_record {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+    uint32_t path_len;
+    uint32_t reserved;
+};
+
+// A file of the index, in memory
+struct finder_index_file {
+    const char *path;
+    struct finder_index_record record;
+    uint64_t counts[FINDER_INDEX_SEARCHES];
+};
+
+// An index loaded from disk, read only once loaded so threads can share it
+struct finder_index {
+    char *data;
+    unsigned int search_count;
+    const char *searches[FINDER_INDEX_SEARCHES];
+    size_t search_lens[FINDER_INDEX_SEARCHES];
+    struct finder_index_file *files;
+    size_t file_count;
+    // Open addressed hash table of file index + 1 by path, 0 for an empty bucket
+    size_t *table;
+    size_t table_mask;
+};
+
+// Files collected by one thread for the next index
+struct finder_index_list {
+    struct finder_index_file *files;
+    size_t count;
+    size_t capacity;
+};
+
+/**
+* Load the index at @param path into @param index.  A missing index loads as an empty one, an
+* unreadable or corrupt one as an empty one with a warning on stderr.
+* @return 0, or -1 if out of memory
+*/
+int finder_index_load(struct finder_index *index, const char *path);
+void finder_index_free(struct finder_index *index);
+
+/**
+* @return the slot of the counts for @param search in @param index, or -1 if it has none
+*/
+int finder_index_search_slot(const struct finder_index *index, const char *search, size_t search_len);
+
+/**
+* @return the file of @param index at @param path, or NULL if it has none
+*/
+const struct finder_index_file *finder_index_lookup(const struct finder_index *index, const char *path);
+
+/**
+* Fill @param record with the identity of the file described by @param st
+*/
+void finder_index_record_from_stat(struct finder_index_record *record, const struct stat *st);
+
+/**
+* @return true if @param st describes the same unmodified file as @param record
+*/
+bool finder_index_record_matches(const struct finder_index_record *record, const struct stat *st);
+
+/**
+* Append a copy of @param file, including its path, to @param list
+* @return false if out of memory
+*/
+bool finder_index_list_add(struct finder_index_list *list, const struct finder_index_file *file);
+void finder_index_list_free(struct finder_index_list *list);
+
+/**
+* Atomically replace the index at @param path with the files of @param lists, whose counts are
+* for the @param search_count strings of @param searches.
+* @return 0, or -1 with errno set
+*/
+int finder_index_save(const char *path, const char *const *searches, const size_t *search_lens,
+        unsigned int search_count, const struct finder_index_list *lists, unsigned int list_count);
+
+#endif /* FINDER_INDEX_H */
@@ -0,0 +1,143 @@
+#!/bin/sh
+# Checks writer's modes and the native finder against find and grep
+# Run after make, from any directory: finder-app/finder-native-test.sh
+
+set -e
+set -u
+
+cd "$(dirname "$0")"
+TESTDIR=$(mktemp -d /tmp/finder-native-test.XXXXXX)
+trap 'rm -rf "$TESTDIR"' EXIT
+failures=0
+
+fail()
+{
+	echo "failed: $*"
+	failures=$((failures + 1))
+}
+
+# Compare each file written for the pairs in $TESTDIR/pairs with its expected content
+check_pairs()
+{
+	while IFS="$(printf '\t')" read -r file content
+	do
+		if [ "$(cat "$file")" != "$content" ]; then
+			fail "$1: $file holds '$(cat "$file")' instead of '$content'"
+		fi
+	done < "$TESTDIR/pairs"
+}
+
+# writer, from arguments, from stdin and through io_uring
+mkdir -p "$TESTDIR/writer"
+./writer "$TESTDIR/writer/args" "from arguments"
+if [ "$(cat "$TESTDIR/writer/args")" != "from arguments" ]; then
+	fail "writer file content"
+fi
+for i in $(seq 1 100)
+do
+	printf '%s\t%s\n' "$TESTDIR/writer/file$i" "line $i of the stdin pairs"
+done > "$TESTDIR/pairs"
+for mode in "-" "-u -"
+do
+	rm -f "$TESTDIR"/writer/file*
+	./writer $mode < "$TESTDIR/pairs"
+	check_pairs "writer $mode"
+done
+
+# writer's crash-safe, preallocated and O_DIRECT modes, with content both below and above the
+# 64 KiB from which -d writes directly, must leave byte-identical files
+head -c 300000 /dev/urandom | base64 | tr -d '\n' > "$TESTDIR/large"
+printf '%s' "short content" > "$TESTDIR/short"
+for mode in -s -p -d "-s -d" "-s -p -d" "-u -s -d"
+do
+	for content in short large
+	do
+		rm -f "$TESTDIR/writer/$content"
+		printf '%s\t%s\n' "$TESTDIR/writer/$content" "$(cat "$TESTDIR/$content")" | ./writer $mode -
+		if ! cmp -s "$TESTDIR/$content" "$TESTDIR/writer/$content"; then
+			fail "writer $mode: $content content differs"
+		fi
+	done
+	# Replacing a longer file leaves nothing of it behind
+	./writer $mode "$TESTDIR/writer/large" "$(cat "$TESTDIR/short")"
+	if ! cmp -s "$TESTDIR/short" "$TESTDIR/writer/large"; then
+		fail "writer $mode: overwritten content differs"
+	fi
+done
+if ls -a "$TESTDIR/writer" | grep -q '\.tmp$'; then
+	fail "writer -s left temporary files"
+fi
+
+# Summary of finder.sh for a fixed string, from find and grep
+reference()
+{
+	files=$(find "$1" -type f | wc -l)
+	lines=$(find "$1" -type f -exec grep -c -h -F -e "$2" {} + | awk '{ total += $1 } END { print total + 0 }')
+	echo "The number of files are $files and the number of matching lines are $lines"
+}
+
+# Compare finder $3... with the reference on directory $1 for search string $2
+check_finder()
+{
+	dir=$1
+	search=$2
+	shift 2
+	expected=$(reference "$dir" "$search")
+	actual=$(./finder "$@" "$dir" "$search")
+	if [ "$actual" != "$expected" ]; then
+		fail "finder $* '$search': '$actual' instead of '$expected'"
+	fi
+}
+
+# A tree of small files, files larger than finder's 64 KiB read buffer, an empty file and a
+# last line without a newline
+TREE="$TESTDIR/tree"
+for i in $(seq 1 30)
+do
+	dir="$TREE/d$((i % 4))/e$((i % 3))"
+	mkdir -p "$dir"
+	seq 1 $((i * 50)) | sed 's/^/AELD line /' > "$dir/small$i.txt"
+done
+seq 1 40000 | sed 's/7/AELD seven/' > "$TREE/d1/large.txt"
+seq 1 20000 > "$TREE/d2/e1/large-nomatch.txt"
+: > "$TREE/empty.txt"
+printf 'AELD\nno\nAELD without newline' > "$TREE/d0/last.txt"
+
+for search in AELD "line 1" seven "AELD line 49" nomatch ""
+do
+	check_finder "$TREE" "$search"
+	check_finder "$TREE" "$search" -j 1
+done
+
+# finder -i, across changes to the tree between runs.  The index stores no counts for a file
+# changed in the last second, so the files are backdated and their change times left to age.
+INDEX="$TESTDIR/index"
+find "$TREE" -type f -exec touch -d '2020-01-01 00:00' {} +
+sleep 2
+for search in AELD seven AELD
+do
+	check_finder "$TREE" "$search" -i "$INDEX"
+done
+# Grown
+echo "AELD appended" >> "$TREE/d1/large.txt"
+check_finder "$TREE" AELD -i "$INDEX"
+# Rewritten at the same size with its modification time restored, as by touch -r or rsync -t
+sed 's/AELD/aeld/' "$TREE/d0/last.txt" > "$TESTDIR/last.txt"
+cp "$TESTDIR/last.txt" "$TREE/d0/last.txt"
+touch -d '2020-01-01 00:00' "$TREE/d0/last.txt"
+check_finder "$TREE" AELD -i "$INDEX"
+# Added and removed
+echo "AELD added" > "$TREE/d3/added.txt"
+rm "$TREE/d2/e1/large-nomatch.txt"
+check_finder "$TREE" AELD -i "$INDEX"
+check_finder "$TREE" seven -i "$INDEX"
+# A corrupt index is rebuilt
+head -c 100 /dev/urandom > "$INDEX"
+check_finder "$TREE" AELD -i "$INDEX" 2>/dev/null
+check_finder "$TREE" AELD -i "$INDEX"
+
+if [ $failures -ne 0 ]; then
+	echo "$failures checks failed"
+	exit 1
+fi
+echo "success"
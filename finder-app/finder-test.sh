@@ -52,10 +52,11 @@ fi
 #make clean
 #make
 
+# One writer process for all files, reading "<file><tab><content>" lines from stdin
 for i in $( seq 1 $NUMFILES)
 do
-	writer "$WRITEDIR/${username}$i.txt" "$WRITESTR"
-done
+	printf '%s\t%s\n' "$WRITEDIR/${username}$i.txt" "$WRITESTR"
+done | writer -
 
 OUTPUTSTRING=$(finder.sh "$WRITEDIR" "$WRITESTR")
 
@@ -0,0 +1,590 @@
+/*
+* Native replacement for finder.sh
+*
+* Usage: finder [-j threads] [-i index] <filesdir> <searchstr>
+*   Counts the regular files under filesdir and the lines in them containing searchstr, and
+*   prints the same summary as finder.sh.  searchstr is matched as a fixed string, like grep -F,
+*   and may not contain a newline, which grep would take as several patterns.
+*   With -i, the match counts of files which did not change since the last run with the same
+*   index file are taken from the index instead of reading the files, see finder-index.h.
+*
+* Directories are walked by a pool of threads, each with its own deque of directories to visit.
+* A thread pushes the subdirectories it finds onto its own deque and takes its next directory
+* from there, and when that is empty steals the oldest directory of another thread, so the
+* threads stay busy however unbalanced the tree is.  Files are searched by the thread which
+* found them, small ones read into a buffer and large ones memory mapped.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "finder-index.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Files up to this size are read() into the thread's buffer instead of being mapped
+#define READ_BUFFER_SIZE (64 * 1024)
+#define MAX_THREADS 256
+
+// Directories waiting to be visited by one thread
+struct dir_deque {
+    pthread_mutex_t lock;
+    char **paths;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+};
+
+struct finder;
+
+struct finder_thread {
+    pthread_t thread;
+    struct finder *finder;
+    unsigned int index;
+    struct dir_deque deque;
+    char *buffer;
+    unsigned long files;
+    unsigned long lines;
+    // Files seen by this thread, for the next index
+    struct finder_index_list index_list;
+};
+
+struct finder {
+    const char *search;
+    size_t search_len;
+    struct finder_thread *threads;
+    unsigned int thread_count;
+    // Directories pushed but not yet completely visited, the walk is over when it reaches 0
+    atomic_long pending;
+    // Incremented by every push, so an idle thread can tell whether work appeared while it looked
+    atomic_ulong work_seq;
+    atomic_int idle;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    // Index of the previous run, NULL without -i
+    const struct finder_index *index;
+    // Search strings of the next index, this search first, and the slot of each in index
+    unsigned int search_count;
+    const char *searches[FINDER_INDEX_SEARCHES];
+    size_t search_lens[FINDER_INDEX_SEARCHES];
+    int old_slots[FINDER_INDEX_SEARCHES];
+    // Files modified at or after this time might change again within the same mtime tick
+    time_t racy_mtime;
+};
+
+static bool deque_push(struct dir_deque *deque, char *path){
+    char **paths;
+    size_t count;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail == deque->capacity) {
+        // Slide the remaining entries to the front before growing
+        count = deque->tail - deque->head;
+        if (deque->head > 0 && count < deque->capacity / 2) {
+            memmove(deque->paths, &deque->paths[deque->head], count * sizeof(char *));
+        }
+        else {
+            paths = realloc(deque->paths, (deque->capacity ? deque->capacity * 2 : 64) * sizeof(char *));
+            if (paths == NULL) {
+                pthread_mutex_unlock(&deque->lock);
+                return false;
+            }
+            memmove(paths, &paths[deque->head], count * sizeof(char *));
+            deque->paths = paths;
+            deque->capacity = deque->capacity ? deque->capacity * 2 : 64;
+        }
+        deque->head = 0;
+        deque->tail = count;
+    }
+    deque->paths[deque->tail++] = path;
+    pthread_mutex_unlock(&deque->lock);
+    return true;
+}
+
+// Take the newest directory, the owner's end of the deque
+static char *deque_pop(struct dir_deque *deque){
+    char *path = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail > deque->head) {
+        path = deque->paths[--deque->tail];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return path;
+}
+
+// Take the oldest directory, likely the root of the largest unvisited subtree
+static char *deque_steal(struct dir_deque *deque){
+    char *path = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail > deque->head) {
+        path = deque->paths[deque->head++];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return path;
+}
+
+static void push_dir(struct finder_thread *self, char *path){
+    struct finder *finder = self->finder;
+
+    atomic_fetch_add(&finder->pending, 1);
+    if (!deque_push(&self->deque, path)) {
+        fprintf(stderr, "finder: out of memory queueing %s\n", path);
+        free(path);
+        atomic_fetch_sub(&finder->pending, 1);
+        return;
+    }
+    atomic_fetch_add(&finder->work_seq, 1);
+    if (atomic_load(&finder->idle) > 0) {
+        pthread_mutex_lock(&finder->idle_lock);
+        pthread_cond_broadcast(&finder->idle_cond);
+        pthread_mutex_unlock(&finder->idle_lock);
+    }
+}
+
+// Find needle in haystack, needle_len must be at least 1
+static const char *find_substring(const char *haystack, size_t len, const char *needle, size_t needle_len){
+#ifdef __SSE2__
+    // Compare 16 candidate positions at once on the first and last byte of needle, and only
+    // memcmp() the positions where both match
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    unsigned int mask;
+    size_t i = 0;
+    int bit;
+
+    if (needle_len > 1) {
+        for (; i + needle_len - 1 + 16 <= len; i += 16) {
+            __m128i block_first = _mm_loadu_si128((const __m128i *)&haystack[i]);
+            __m128i block_last = _mm_loadu_si128((const __m128i *)&haystack[i + needle_len - 1]);
+
+            mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                    _mm_cmpeq_epi8(last, block_last)));
+            while (mask != 0) {
+                bit = __builtin_ctz(mask);
+                if (memcmp(&haystack[i + bit + 1], needle + 1, needle_len - 2) == 0) {
+                    return &haystack[i + bit];
+                }
+                mask &= mask - 1;
+            }
+        }
+    }
+    return memmem(&haystack[i], len - i, needle, needle_len);
+#else
+    return memmem(haystack, len, needle, needle_len);
+#endif
+}
+
+// Count the lines of data containing the search string, as grep -c does
+static unsigned long count_matching_lines(const struct finder *finder, const char *data, size_t len){
+    const char *end = data + len;
+    const char *match;
+    const char *newline;
+    unsigned long lines = 0;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (finder->search_len == 0) {
+        // Every line matches, including a last line without a newline
+        while ((newline = memchr(data, '\n', end - data)) != NULL) {
+            lines++;
+            data = newline + 1;
+        }
+        return lines + (data < end);
+    }
+
+    while (data < end) {
+        match = find_substring(data, end - data, finder->search, finder->search_len);
+        if (match == NULL) {
+            break;
+        }
+        lines++;
+        // Skip the rest of the matching line
+        newline = memchr(match, '\n', end - match);
+        data = (newline != NULL) ? newline + 1 : end;
+    }
+    return lines;
+}
+
+// Read from fd until end of file or size bytes, returns the number of bytes read or -1
+static ssize_t read_full(int fd, char *buf, size_t size){
+    size_t done = 0;
+    ssize_t len;
+
+    while (done < size) {
+        len = read(fd, buf + done, size - done);
+        if (len == 0) {
+            break;
+        }
+        if (len == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += len;
+    }
+    return done;
+}
+
+// Count the matching lines of a file, returns -1 if it could not be read
+static long search_file(struct finder_thread *self, int dirfd, const char *name, const char *dir){
+    struct stat st;
+    long lines = -1;
+    ssize_t len;
+    void *map;
+    int fd;
+
+    fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NOCTTY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "finder: %s/%s: %s\n", dir, name, strerror(errno));
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    if (st.st_size <= READ_BUFFER_SIZE) {
+        // One byte more than fits tells a file which grew past the buffer since fstat()
+        len = read_full(fd, self->buffer, READ_BUFFER_SIZE + 1);
+        if (len == -1) {
+            fprintf(stderr, "finder: %s/%s: %s\n", dir, name, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        if (len <= READ_BUFFER_SIZE) {
+            close(fd);
+            return count_matching_lines(self->finder, self->buffer, len);
+        }
+        if (fstat(fd, &st) == -1) {
+            fprintf(stderr, "finder: %s/%s: %s\n", dir, name, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "finder: %s/%s: %s\n", dir, name, strerror(errno));
+        }
+        else {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            lines = count_matching_lines(self->finder, map, st.st_size);
+            munmap(map, st.st_size);
+        }
+    }
+    else {
+        lines = 0;  // Truncated again after growing past the buffer
+    }
+    close(fd);
+    return lines;
+}
+
+// Count the matching lines of a file, reusing the count of the previous index if it is unchanged,
+// and add it to the next index
+static long search_indexed_file(struct finder_thread *self, int dirfd, const char *name, const char *dir){
+    const struct finder *finder = self->finder;
+    const struct finder_index_file *old = NULL;
+    struct finder_index_file file;
+    struct stat st;
+    unsigned int i;
+    size_t path_len = strlen(dir) + strlen(name) + 2;
+    char path[path_len];
+    long lines;
+
+    snprintf(path, path_len, "%s/%s", dir, name);
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+        return search_file(self, dirfd, name, dir);
+    }
+    old = finder_index_lookup(finder->index, path);
+    if (old != NULL && !finder_index_record_matches(&old->record, &st)) {
+        old = NULL;
+    }
+
+    if (old != NULL && finder->old_slots[0] >= 0 && old->counts[finder->old_slots[0]] != FINDER_INDEX_UNKNOWN) {
+        lines = old->counts[finder->old_slots[0]];
+    }
+    else {
+        lines = search_file(self, dirfd, name, dir);
+        if (lines < 0) {
+            return lines;
+        }
+    }
+
+    file.path = path;
+    finder_index_record_from_stat(&file.record, &st);
+    for (i = 0; i < FINDER_INDEX_SEARCHES; i++) {
+        file.counts[i] = FINDER_INDEX_UNKNOWN;
+    }
+    // A file written in the same second as the search could change again without its size,
+    // mtime or ctime changing, so only its identity is remembered
+    if ((st.st_mtim.tv_sec < finder->racy_mtime) && (st.st_ctim.tv_sec < finder->racy_mtime)) {
+        file.counts[0] = lines;
+        for (i = 1; old != NULL && i < finder->search_count; i++) {
+            if (finder->old_slots[i] >= 0) {
+                file.counts[i] = old->counts[finder->old_slots[i]];
+            }
+        }
+    }
+    if (!finder_index_list_add(&self->index_list, &file)) {
+        fprintf(stderr, "finder: out of memory indexing %s\n", path);
+    }
+    return lines;
+}
+
+static void visit_dir(struct finder_thread *self, const char *path){
+    struct dirent *entry;
+    struct stat st;
+    unsigned char type;
+    size_t path_len = strlen(path);
+    char *subdir;
+    long lines;
+    DIR *dir;
+
+    dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "finder: %s: %s\n", path, strerror(errno));
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        type = entry->d_type;
+        // Not every file system fills in d_type.  Like find, symbolic links are not followed.
+        if (type == DT_UNKNOWN) {
+            if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if (type == DT_REG) {
+            self->files++;
+            lines = (self->finder->index != NULL) ? search_indexed_file(self, dirfd(dir), entry->d_name, path)
+                                                  : search_file(self, dirfd(dir), entry->d_name, path);
+            if (lines > 0) {
+                self->lines += lines;
+            }
+        }
+        else if (type == DT_DIR) {
+            subdir = malloc(path_len + strlen(entry->d_name) + 2);
+            if (subdir == NULL) {
+                fprintf(stderr, "finder: out of memory\n");
+                continue;
+            }
+            sprintf(subdir, "%s/%s", path, entry->d_name);
+            push_dir(self, subdir);
+        }
+    }
+    closedir(dir);
+}
+
+static char *take_dir(struct finder_thread *self){
+    struct finder *finder = self->finder;
+    char *path;
+    unsigned int i;
+
+    path = deque_pop(&self->deque);
+    for (i = 1; path == NULL && i < finder->thread_count; i++) {
+        path = deque_steal(&finder->threads[(self->index + i) % finder->thread_count].deque);
+    }
+    return path;
+}
+
+static void *finder_worker(void *arg){
+    struct finder_thread *self = arg;
+    struct finder *finder = self->finder;
+    unsigned long seq;
+    char *path;
+
+    for (;;) {
+        seq = atomic_load(&finder->work_seq);
+        path = take_dir(self);
+        if (path != NULL) {
+            visit_dir(self, path);
+            free(path);
+            if (atomic_fetch_sub(&finder->pending, 1) == 1) {
+                // Last directory done, wake everyone to exit
+                pthread_mutex_lock(&finder->idle_lock);
+                pthread_cond_broadcast(&finder->idle_cond);
+                pthread_mutex_unlock(&finder->idle_lock);
+            }
+            continue;
+        }
+
+        // Sleep until a directory is pushed after seq was read or the walk is over
+        pthread_mutex_lock(&finder->idle_lock);
+        atomic_fetch_add(&finder->idle, 1);
+        while (atomic_load(&finder->work_seq) == seq && atomic_load(&finder->pending) > 0) {
+            pthread_cond_wait(&finder->idle_cond, &finder->idle_lock);
+        }
+        atomic_fetch_sub(&finder->idle, 1);
+        pthread_mutex_unlock(&finder->idle_lock);
+        if (atomic_load(&finder->pending) == 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]){
+    struct finder finder = { 0 };
+    struct finder_index index;
+    struct finder_index_list *lists;
+    const char *index_path = NULL;
+    unsigned long files = 0;
+    unsigned long lines = 0;
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    struct stat st;
+    char *root;
+    unsigned int i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:i:")) != -1) {
+        switch (opt) {
+        case 'j':
+            thread_count = atol(optarg);
+            break;
+        case 'i':
+            index_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-j threads] [-i index] <filepath> <search_string>\n", argv[0]);
+            return 1;
+        }
+    }
+    // Check number of arguments
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-j threads] [-i index] <filepath> <search_string>\n", argv[0]);
+        return 1;
+    }
+    // Check if specified directory exist
+    if (stat(argv[optind], &st) == -1 || !S_ISDIR(st.st_mode)) {
+        printf("Error: Specified filepath '%s' is not a directory or does not exist\n", argv[optind]);
+        return 1;
+    }
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+    if (thread_count > MAX_THREADS) {
+        thread_count = MAX_THREADS;
+    }
+
+    finder.search = argv[optind + 1];
+    finder.search_len = strlen(finder.search);
+    if (memchr(finder.search, '\n', finder.search_len) != NULL) {
+        fprintf(stderr, "finder: search string may not contain a newline\n");
+        return 1;
+    }
+    finder.thread_count = thread_count;
+    finder.threads = calloc(thread_count, sizeof(struct finder_thread));
+    if (finder.threads == NULL) {
+        fprintf(stderr, "finder: out of memory\n");
+        return 1;
+    }
+    pthread_mutex_init(&finder.idle_lock, NULL);
+    pthread_cond_init(&finder.idle_cond, NULL);
+    for (i = 0; i < finder.thread_count; i++) {
+        finder.threads[i].finder = &finder;
+        finder.threads[i].index = i;
+        pthread_mutex_init(&finder.threads[i].deque.lock, NULL);
+        finder.threads[i].buffer = malloc(READ_BUFFER_SIZE + 1);
+        if (finder.threads[i].buffer == NULL) {
+            fprintf(stderr, "finder: out of memory\n");
+            return 1;
+        }
+    }
+
+    if (index_path != NULL) {
+        if (finder_index_load(&index, index_path) != 0) {
+            fprintf(stderr, "finder: out of memory\n");
+            return 1;
+        }
+        finder.index = &index;
+        // This search becomes the most recent one, followed by the others the index has counts for
+        finder.searches[0] = finder.search;
+        finder.search_lens[0] = finder.search_len;
+        finder.old_slots[0] = finder_index_search_slot(&index, finder.search, finder.search_len);
+        finder.search_count = 1;
+        for (i = 0; i < index.search_count && finder.search_count < FINDER_INDEX_SEARCHES; i++) {
+            if ((int)i != finder.old_slots[0]) {
+                finder.searches[finder.search_count] = index.searches[i];
+                finder.search_lens[finder.search_count] = index.search_lens[i];
+                finder.old_slots[finder.search_count] = i;
+                finder.search_count++;
+            }
+        }
+        finder.racy_mtime = time(NULL) - 1;
+    }
+
+    // Index paths are absolute, so the same tree hits the index from any working directory
+    root = (index_path != NULL) ? realpath(argv[optind], NULL) : strdup(argv[optind]);
+    if (root == NULL) {
+        fprintf(stderr, "finder: out of memory\n");
+        return 1;
+    }
+    // Strip trailing slashes so paths in messages read like find's
+    for (i = strlen(root); i > 1 && root[i - 1] == '/'; i--) {
+        root[i - 1] = '\0';
+    }
+    push_dir(&finder.threads[0], root);
+
+    for (i = 0; i < finder.thread_count; i++) {
+        if (pthread_create(&finder.threads[i].thread, NULL, finder_worker, &finder.threads[i]) != 0) {
+            fprintf(stderr, "finder: failed to create thread\n");
+            return 1;
+        }
+    }
+    for (i = 0; i < finder.thread_count; i++) {
+        pthread_join(finder.threads[i].thread, NULL);
+    }
+    if (index_path != NULL) {
+        lists = malloc(finder.thread_count * sizeof(struct finder_index_list));
+        if (lists == NULL) {
+            fprintf(stderr, "finder: out of memory\n");
+            return 1;
+        }
+        for (i = 0; i < finder.thread_count; i++) {
+            lists[i] = finder.threads[i].index_list;
+        }
+        if (finder_index_save(index_path, finder.searches, finder.search_lens, finder.search_count,
+                    lists, finder.thread_count) != 0) {
+            fprintf(stderr, "finder: could not save index %s: %s\n", index_path, strerror(errno));
+        }
+        free(lists);
+        // The search strings of the next index point into the old one, free it only now
+        finder_index_free(&index);
+    }
+
+    // Only tear down once every thread has stopped stealing from the others
+    for (i = 0; i < finder.thread_count; i++) {
+        finder_index_list_free(&finder.threads[i].index_list);
+        files += finder.threads[i].files;
+        lines += finder.threads[i].lines;
+        free(finder.threads[i].buffer);
+        free(finder.threads[i].deque.paths);
+        pthread_mutex_destroy(&finder.threads[i].deque.lock);
+    }
+    pthread_cond_destroy(&finder.idle_cond);
+    pthread_mutex_destroy(&finder.idle_lock);
+    free(finder.threads);
+
+    printf("The number of files are %lu and the number of matching lines are %lu\n", files, lines);
+    return 0;
+}
@@ -1,73 +1,641 @@
 /*
 * Author: Mubeena Udyavar Kazi
 * Course: ECEN 5713 - AESD
-* Reference: 
+* Reference:
 *   1. ChatGPT with prompt "file I/O using system calls C"
-*   2. Stack overflow           
+*   2. Stack overflow
+*
+* Usage: writer [-u] [-s] [-p] [-d] <file> <content> [<file> <content>...]
+*        writer [-u] [-s] [-p] [-d] -
+*   Writes each content string to its file.  With "-" the (file, content) pairs are read from
+*   stdin instead, one per line with the file and the content separated by a tab.
+*   -u  submit the writes in batches through io_uring, when the kernel supports IORING_OP_WRITE
+*   -s  crash safe: write a temporary file, fsync it and rename it over the file, so the file
+*       has either its old or its complete new content after a crash
+*   -p  preallocate each file with fallocate() before writing it
+*   -d  write content of DIRECT_MIN_SIZE bytes or more with O_DIRECT, bypassing the page cache
+*   -s, -p and -d write synchronously, -u only applies without them.
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include<syslog.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/io_uring.h>
 
-// Function to write string to file
-void write_str_to_file(char *writefile, char *writestr){
-    openlog("writer.c", LOG_PID, LOG_USER);
+#define FILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+
+// Smaller content is not worth the alignment copy of O_DIRECT, the page cache absorbs it
+#define DIRECT_MIN_SIZE (64 * 1024)
+// Buffer and length alignment which satisfies O_DIRECT on common block devices
+#define DIRECT_ALIGN 4096
+
+// Number of writes submitted to io_uring at once
+#define URING_ENTRIES 64
+
+// Directory of the last file created, kept open so the next file in it is created with openat()
+// without the kernel walking the whole path again
+struct dir_cache {
+    char path[PATH_MAX];
+    int fd;
+    // A file was renamed into the directory, which must be fsync()ed for the rename to be durable
+    bool dirty;
+};
+
+struct write_options {
+    bool durable;
+    bool preallocate;
+    bool direct;
+};
+
+// Where (file, content) pairs come from, the command line or a stream
+struct pair_source {
+    char **argv;
+    int argc;
+    int next;
+    FILE *stream;
+    char *line;
+    size_t line_size;
+};
+
+// A file opened and waiting for its content to be written through io_uring
+struct pending_write {
+    int fd;
+    char *writefile;
+    char *writestr;
+    size_t len;
+};
+
+// Submission and completion rings shared with the kernel, see io_uring_setup(2)
+struct uring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+};
+
+// Verify a (file, content) pair, logging the reason it is invalid
+static int check_pair(const char *writefile, const char *writestr){
     // Verify whether the writefile and writestr pointers are NULL
     if (writefile == NULL  || writestr == NULL){
         syslog(LOG_ERR, "ERROR: Expected valid pointer, but received NULL pointer");
-        closelog();
-        exit(1);
+        return -1;
     }
 
     // Verify whether filename argument is empty.
     if (strlen(writefile) == 0){
         syslog(LOG_ERR, "ERROR: 'filename' argument is not specified.");
-        closelog();
-        exit(1);
+        return -1;
     }
 
     // Verify whether filecontents argument is empty.
     if (strlen(writestr) == 0){
         syslog(LOG_ERR, "ERROR: 'filecontents' argument is not specified.");
-        closelog();
-        exit(1);
+        return -1;
     }
+    return 0;
+}
+
+// Flush the renames into the cached directory to disk and close it
+static int dir_cache_close(struct dir_cache *cache){
+    int ret = 0;
+
+    if (cache->fd >= 0) {
+        if (cache->dirty && fsync(cache->fd) == -1) {
+            syslog(LOG_ERR, "ERROR: Could not sync directory %s: %s", cache->path, strerror(errno));
+            ret = -1;
+        }
+        close(cache->fd);
+    }
+    cache->fd = -1;
+    cache->dirty = false;
+    return ret;
+}
+
+// Get the fd of the directory of writefile from cache, and the name of writefile in it
+static int dir_fd_for(struct dir_cache *cache, const char *writefile, const char **name_rtn){
+    const char *slash = strrchr(writefile, '/');
+    const char *name = writefile;
+    char dir[PATH_MAX];
+    size_t dir_len;
+
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    }
+    else {
+        // Keep the "/" of a file in the root directory
+        dir_len = (slash == writefile) ? 1 : (size_t)(slash - writefile);
+        if (dir_len >= sizeof(dir)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memcpy(dir, writefile, dir_len);
+        dir[dir_len] = '\0';
+        name = slash + 1;
+    }
+
+    if (cache->fd < 0 || strcmp(cache->path, dir) != 0) {
+        dir_cache_close(cache);
+        cache->fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (cache->fd == -1) {
+            return -1;
+        }
+        strcpy(cache->path, dir);
+    }
+    *name_rtn = name;
+    return cache->fd;
+}
+
+// Create or truncate writefile relative to the cached fd of its directory
+static int open_in_dir(struct dir_cache *cache, const char *writefile){
+    const char *name;
+    int dirfd = dir_fd_for(cache, writefile, &name);
+
+    if (dirfd == -1) {
+        return -1;
+    }
+    return openat(dirfd, name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, FILE_MODE);
+}
 
-    // Open() System call is used to create the file
-    int fd = open(writefile, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+// write() all len bytes of buf, continuing after short writes and interruptions
+static int write_all(int fd, const char *buf, size_t len){
+    ssize_t ret;
+
+    while (len > 0) {
+        ret = write(fd, buf, len);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+// Write all of buf to fd at offset, without moving its file position
+static int pwrite_all(int fd, const char *buf, size_t len, off_t offset){
+    ssize_t ret;
+
+    while (len > 0) {
+        ret = pwrite(fd, buf, len, offset);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+// Write buf to the start of fd opened with O_DIRECT, from an aligned copy padded to whole blocks
+// and truncated back to len afterwards
+static int write_direct(int fd, const char *buf, size_t len){
+    size_t padded_len = (len + DIRECT_ALIGN - 1) & ~(size_t)(DIRECT_ALIGN - 1);
+    void *aligned;
+    int ret;
+
+    if (posix_memalign(&aligned, DIRECT_ALIGN, padded_len) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(aligned, buf, len);
+    memset((char *)aligned + len, 0, padded_len - len);
+    ret = write_all(fd, aligned, padded_len);
+    free(aligned);
+    if (ret == -1 && errno == EINVAL) {
+        // The file system wants a larger alignment, write through the page cache instead
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+            return -1;
+        }
+        ret = write_all(fd, buf, len);
+    }
+    if (ret == 0 && ftruncate(fd, len) == -1) {
+        return -1;
+    }
+    return ret;
+}
+
+// Function to write string to file
+int write_str_to_file(struct dir_cache *cache, const struct write_options *options, char *writefile, char *writestr){
+    size_t len;
+    bool direct;
+    const char *name;
+    const char *final_name;
+    char tmp_name[NAME_MAX + 1];
+    int dirfd;
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    int fd;
+
+    if (check_pair(writefile, writestr) != 0) {
+        return -1;
+    }
+    len = strlen(writestr);
+    direct = options->direct && len >= DIRECT_MIN_SIZE;
+
+    dirfd = dir_fd_for(cache, writefile, &name);
+    if (dirfd == -1){
+        syslog(LOG_ERR, "ERROR: Could not open directory of %s file", writefile);
+        return -1;
+    }
+    final_name = name;
+    if (options->durable) {
+        // A new file beside the target, renamed over it once complete
+        if (snprintf(tmp_name, sizeof(tmp_name), ".%s.%ld.tmp", name, (long)getpid()) >= (int)sizeof(tmp_name)) {
+            syslog(LOG_ERR, "ERROR: File name %s too long", writefile);
+            return -1;
+        }
+        name = tmp_name;
+        flags |= O_EXCL;
+    }
+    else {
+        flags |= O_TRUNC;
+    }
+
+    // openat() System call is used to create the file
+    fd = openat(dirfd, name, flags | (direct ? O_DIRECT : 0), FILE_MODE);
+    if (fd == -1 && direct && errno == EINVAL) {
+        // File system without O_DIRECT support, like tmpfs
+        direct = false;
+        fd = openat(dirfd, name, flags, FILE_MODE);
+    }
     if (fd == -1){
         syslog(LOG_ERR, "ERROR: Could not create %s file", writefile);
-        closelog();
-        exit(1);
+        return -1;
+    }
+
+    // Reserve the blocks up front, so the file is contiguous and the write cannot fail with ENOSPC
+    if (options->preallocate && fallocate(fd, 0, 0, len) == -1 && errno != EOPNOTSUPP && errno != ENOSYS) {
+        syslog(LOG_ERR, "ERROR: Could not allocate %zu bytes for %s file: %s", len, writefile, strerror(errno));
+        goto error;
     }
     // write() system call is used to write to file descriptor
-    if (write(fd, writestr, strlen(writestr)) == -1) {
-        syslog(LOG_ERR, "ERROR: Could not write to %s file", writefile);
-        close(fd);
-        closelog();
-        exit(1);
+    if ((direct ? write_direct(fd, writestr, len) : write_all(fd, writestr, len)) == -1) {
+        syslog(LOG_ERR, "ERROR: Could not write to %s file: %s", writefile, strerror(errno));
+        goto error;
+    }
+    if (options->durable && fsync(fd) == -1) {
+        syslog(LOG_ERR, "ERROR: Could not sync %s file: %s", writefile, strerror(errno));
+        goto error;
     }
     close(fd);
 
+    if (options->durable) {
+        if (renameat(dirfd, tmp_name, dirfd, final_name) == -1) {
+            syslog(LOG_ERR, "ERROR: Could not rename %s to %s: %s", tmp_name, writefile, strerror(errno));
+            unlinkat(dirfd, tmp_name, 0);
+            return -1;
+        }
+        cache->dirty = true;
+    }
+
     syslog(LOG_DEBUG, "Writing '%s' to %s", writestr, writefile);
-    closelog();
+    return 0;
+
+error:
+    close(fd);
+    if (options->durable) {
+        unlinkat(dirfd, tmp_name, 0);
+    }
+    return -1;
+}
+
+// Get the next pair from src, returns 1 for a pair, 0 at the end and -1 for a malformed line
+static int next_pair(struct pair_source *src, char **writefile, char **writestr){
+    ssize_t len;
+    char *tab;
+
+    if (src->stream == NULL) {
+        if (src->next + 1 >= src->argc) {
+            return 0;
+        }
+        *writefile = src->argv[src->next++];
+        *writestr = src->argv[src->next++];
+        return 1;
+    }
+
+    len = getline(&src->line, &src->line_size, src->stream);
+    if (len == -1) {
+        return 0;
+    }
+    if (len > 0 && src->line[len - 1] == '\n') {
+        src->line[len - 1] = '\0';
+    }
+    tab = strchr(src->line, '\t');
+    if (tab == NULL) {
+        syslog(LOG_ERR, "ERROR: Expected <file><tab><content>, got '%s'", src->line);
+        return -1;
+    }
+    *tab = '\0';
+    *writefile = src->line;
+    *writestr = tab + 1;
+    return 1;
+}
+
+// Returns true if the io_uring @param ring_fd supports IORING_OP_WRITE.  io_uring predates the
+// opcode: Linux 5.1 to 5.5 fail every such write with EINVAL, and have no IORING_REGISTER_PROBE.
+static bool uring_supports_write(int ring_fd){
+    struct io_uring_probe *probe;
+    bool supported = false;
+
+    probe = calloc(1, sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op));
+    if (probe == NULL) {
+        return false;
+    }
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0) {
+        supported = IORING_OP_WRITE < probe->ops_len &&
+                (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return supported;
+}
+
+static int uring_init(struct uring *ring, unsigned entries){
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(struct uring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+    // Check before any file is opened truncated for a write which would only fail
+    if (!uring_supports_write(ring->fd)) {
+        close(ring->fd);
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // Since Linux 5.4 both rings are mapped by the one mmap() of the submission ring
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = 0;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+    if (ring->cq_ring_size == 0) {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ring_size != 0) {
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        }
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sq_head = (unsigned *)((char *)ring->sq_ring + params.sq_off.head);
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ring + params.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ring + params.cq_off.cqes);
+    return 0;
+}
+
+static void uring_exit(struct uring *ring){
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring_size != 0) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// Write every pending file with one io_uring_enter() per round trip, returns the number of failures
+static int uring_write_batch(struct uring *ring, struct pending_write *pending, unsigned count){
+    unsigned tail = *ring->sq_tail;
+    unsigned submitted = 0;
+    unsigned completed = 0;
+    unsigned head;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    struct pending_write *done;
+    int failures = 0;
+    unsigned i;
+    int ret;
+
+    for (i = 0; i < count; i++) {
+        sqe = &ring->sqes[tail & *ring->sq_mask];
+        memset(sqe, 0, sizeof(struct io_uring_sqe));
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = pending[i].fd;
+        sqe->addr = (unsigned long)pending[i].writestr;
+        sqe->len = pending[i].len;
+        sqe->off = 0;  // Files are opened truncated, write from their start
+        sqe->user_data = i;
+        ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+        tail++;
+    }
+    // The kernel must see the entries before the new tail
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    while (completed < count) {
+        ret = syscall(__NR_io_uring_enter, ring->fd, count - submitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            syslog(LOG_ERR, "ERROR: io_uring_enter failed: %s", strerror(errno));
+            exit(1);
+        }
+        submitted += ret;
+
+        head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &ring->cqes[head & *ring->cq_mask];
+            done = &pending[cqe->user_data];
+            if (cqe->res < 0) {
+                syslog(LOG_ERR, "ERROR: Could not write to %s file: %s", done->writefile, strerror(-cqe->res));
+                failures++;
+            }
+            else if ((size_t)cqe->res != done->len &&
+                     pwrite_all(done->fd, done->writestr + cqe->res, done->len - cqe->res, cqe->res) == -1) {
+                // A short write is finished synchronously, at the offset since the queued write
+                // was at explicit offset 0 and left the file position alone
+                syslog(LOG_ERR, "ERROR: Could not write to %s file: %s", done->writefile, strerror(errno));
+                failures++;
+            }
+            else {
+                syslog(LOG_DEBUG, "Writing '%s' to %s", done->writestr, done->writefile);
+            }
+            head++;
+            completed++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    for (i = 0; i < count; i++) {
+        close(pending[i].fd);
+        free(pending[i].writefile);
+        free(pending[i].writestr);
+    }
+    return failures;
+}
+
+// Write every pair of src, queueing them on ring when it is not NULL, returns the number of failures
+static int write_pairs(struct pair_source *src, const struct write_options *options, struct uring *ring){
+    struct dir_cache cache = { .fd = -1 };
+    struct pending_write pending[URING_ENTRIES];
+    unsigned count = 0;
+    char *writefile;
+    char *writestr;
+    int failures = 0;
+    int ret;
+    int fd;
+
+    while ((ret = next_pair(src, &writefile, &writestr)) != 0) {
+        if (ret < 0) {
+            failures++;
+            continue;
+        }
+        if (ring == NULL) {
+            if (write_str_to_file(&cache, options, writefile, writestr) != 0) {
+                failures++;
+            }
+            continue;
+        }
+
+        if (check_pair(writefile, writestr) != 0) {
+            failures++;
+            continue;
+        }
+        fd = open_in_dir(&cache, writefile);
+        if (fd == -1) {
+            syslog(LOG_ERR, "ERROR: Could not create %s file", writefile);
+            failures++;
+            continue;
+        }
+        // The line buffer of a stream is reused by the next pair, keep copies until written
+        pending[count].fd = fd;
+        pending[count].writefile = strdup(writefile);
+        pending[count].writestr = strdup(writestr);
+        pending[count].len = strlen(writestr);
+        if (pending[count].writefile == NULL || pending[count].writestr == NULL) {
+            syslog(LOG_ERR, "ERROR: Failed to malloc");
+            exit(1);
+        }
+        if (++count == URING_ENTRIES) {
+            failures += uring_write_batch(ring, pending, count);
+            count = 0;
+        }
+    }
+    if (count > 0) {
+        failures += uring_write_batch(ring, pending, count);
+    }
+
+    if (dir_cache_close(&cache) != 0) {
+        failures++;
+    }
+    free(src->line);
+    return failures;
 }
+
 int main(int argc, char *argv[]){
+    struct pair_source src = { .argv = argv, .argc = argc };
+    struct write_options options = { 0 };
+    struct uring ring;
+    bool use_uring = false;
+    int failures;
+    int opt;
+
     openlog("writer.c", LOG_PID, LOG_USER);
+    // "+" stops at the first file, so content starting with '-' is not taken for an option
+    while ((opt = getopt(argc, argv, "+uspd")) != -1) {
+        switch (opt) {
+        case 'u':
+            use_uring = true;
+            break;
+        case 's':
+            options.durable = true;
+            break;
+        case 'p':
+            options.preallocate = true;
+            break;
+        case 'd':
+            options.direct = true;
+            break;
+        default:
+            syslog(LOG_ERR, "ERROR: Unknown option");
+            closelog();
+            exit(1);
+        }
+    }
+    src.next = optind;
+
+    if (argc - optind == 1 && strcmp(argv[optind], "-") == 0) {
+        src.stream = stdin;
+    }
     // Verify the number of CLI arguments
-    if (argc < 3){
-       syslog(LOG_ERR, "ERROR: Please specify two arguments"); 
+    else if (argc - optind < 2 || (argc - optind) % 2 != 0){
+        syslog(LOG_ERR, "ERROR: Please specify two arguments");
         closelog();
         exit(1);
     }
-    write_str_to_file(argv[1], argv[2]);
+
+    if (use_uring && (options.durable || options.preallocate || options.direct)) {
+        syslog(LOG_WARNING, "WARNING: -u is ignored with -s, -p or -d");
+        use_uring = false;
+    }
+    if (use_uring && uring_init(&ring, URING_ENTRIES) != 0) {
+        syslog(LOG_WARNING, "WARNING: io_uring unavailable (%s), writing synchronously", strerror(errno));
+        use_uring = false;
+    }
+    failures = write_pairs(&src, &options, use_uring ? &ring : NULL);
+    if (use_uring) {
+        uring_exit(&ring);
+    }
+
     closelog();
-    return 0;
+    return (failures == 0) ? 0 : 1;
 }
-	
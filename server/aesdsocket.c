@@ -8,6 +8,11 @@
 *      - Example in C to use SLIST to manage pthreads
 *      - Example in C to add timestamp in RFC 2822 compliant strftime format every 10 seconds using a thread
 *   2. Stack overflow
+*
+* Usage: aesdsocket [-d] [-u path | -u @name]
+*   -d  run as a daemon
+*   -u  also listen for local clients on a Unix domain stream socket at path, or at name in the
+*       abstract namespace when it starts with '@'.  A relative path is relative to / with -d.
 */
 
 #include <stdio.h>
@@ -16,6 +21,9 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <stddef.h>
 #include <syslog.h>
 #include <signal.h>
 #include <sys/stat.h>
@@ -25,9 +33,15 @@
 #include <time.h> 
 #include <errno.h>
 #include "aesd_ioctl.h"
+#include "adaptive_mutex.h"
 
 int sockfd, datafd;
 
+// Unix domain listener, -1 without -u
+static int unix_sockfd = -1;
+// File system path of the Unix domain listener, removed on exit, empty for an abstract name
+static char unix_socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
 int signal_exit = 0;
 
 #if USE_AESD_CHAR_DEVICE == 1
@@ -52,9 +66,9 @@ struct thread_info_t {
 
 SLIST_HEAD(thread_list_t, thread_info_t) thread_list;
 
-#if USE_AESD_CHAR_DEVICE != 1
-pthread_mutex_t aesddata_file_mutex = PTHREAD_MUTEX_INITIALIZER;
-#endif
+// Held only around one write or seek command to the data file or device, short enough to usually
+// be handed over by spinning
+adaptive_mutex_t aesddata_file_mutex = ADAPTIVE_MUTEX_INITIALIZER;
 
 void cleanup(int exit_code) {
 
@@ -76,6 +90,8 @@ void cleanup(int exit_code) {
 
     // Close open sockets
     if (sockfd >= 0) close(sockfd);
+    if (unix_sockfd >= 0) close(unix_sockfd);
+    if (unix_socket_path[0] != '\0') unlink(unix_socket_path);
 
     // Close file descriptors
     if (datafd >= 0) close(datafd);
@@ -160,13 +176,11 @@ void *handle_connection(void *arg)
 
     while ((recv_size = recv(client_data.client_sockfd, buffer, buffer_size, 0)) > 0) {
         // Append data to file
-#if USE_AESD_CHAR_DEVICE != 1
         // Lock the mutex before writing to the file
-        if (pthread_mutex_lock(&aesddata_file_mutex) != 0) {
+        if (adaptive_mutex_lock(&aesddata_file_mutex) != 0) {
             syslog(LOG_ERR, "ERROR: Failed to acquire mutex!");
             cleanup(EXIT_FAILURE);
         }
-#endif
 #if USE_AESD_CHAR_DEVICE == 1
             const char *ioctl_id_string = "AESDCHAR_IOCSEEKTO:";
             if (strncmp(buffer, ioctl_id_string, strlen(ioctl_id_string)) == 0) {
@@ -192,13 +206,11 @@ write:
 #if USE_AESD_CHAR_DEVICE == 1
             }
 #endif
-#if USE_AESD_CHAR_DEVICE != 1
         // Unlock the mutex after writing to the file
-        if (pthread_mutex_unlock(&aesddata_file_mutex) != 0) {
+        if (adaptive_mutex_unlock(&aesddata_file_mutex) != 0) {
             syslog(LOG_ERR, "ERROR: Failed to release mutex!");
             cleanup(EXIT_FAILURE);
         }
-#endif
 
         // Send data back to client if a complete packet is received (ends with newline)
         if (memchr(buffer, '\n', buffer_size) != NULL) {
@@ -244,13 +256,13 @@ void *timestamp_handler(void *arg) {
 
         // Append timestamp to /var/tmp/aesdsocketdata
         // Lock the mutex before writing to the file
-        if (pthread_mutex_lock(&aesddata_file_mutex) != 0) {
+        if (adaptive_mutex_lock(&aesddata_file_mutex) != 0) {
             syslog(LOG_ERR, "ERROR: Failed to acquire mutex!");
             cleanup(EXIT_FAILURE);
         }
         write(datafd, timestamp, strlen(timestamp));
         // Unlock the mutex after writing to the file
-        if (pthread_mutex_unlock(&aesddata_file_mutex) != 0) {
+        if (adaptive_mutex_unlock(&aesddata_file_mutex) != 0) {
             syslog(LOG_ERR, "ERROR: Failed to release mutex!");
             cleanup(EXIT_FAILURE);
         }
@@ -262,10 +274,75 @@ void *timestamp_handler(void *arg) {
 }
 #endif
 
+// Listen on a Unix domain stream socket, a file system path or an abstract name starting with '@'
+int open_unix_listener(const char *name) {
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    size_t name_len = strlen(name);
+    struct stat st;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (name[0] == '@') {
+        // Abstract names start with a NUL byte, are not NUL terminated and leave no file behind
+        if (name_len > sizeof(addr.sun_path)) {
+            syslog(LOG_ERR, "ERROR: Unix socket name %s too long", name);
+            return -1;
+        }
+        memcpy(addr.sun_path + 1, name + 1, name_len - 1);
+        addr_len = offsetof(struct sockaddr_un, sun_path) + name_len;
+    }
+    else {
+        if (name_len >= sizeof(addr.sun_path)) {
+            syslog(LOG_ERR, "ERROR: Unix socket path %s too long", name);
+            return -1;
+        }
+        strcpy(addr.sun_path, name);
+        addr_len = offsetof(struct sockaddr_un, sun_path) + name_len + 1;
+        // Remove the socket of a previous run which did not exit cleanly, but nothing else
+        if (lstat(name, &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(name);
+        }
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        syslog(LOG_ERR, "ERROR: Failed to create Unix socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr*)&addr, addr_len) == -1) {
+        syslog(LOG_ERR, "ERROR: Failed to bind %s: %s", name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (name[0] != '@') {
+        strcpy(unix_socket_path, name);
+    }
+    if (listen(fd, 5) == -1) {
+        syslog(LOG_ERR, "ERROR: Failed to listen on %s", name);
+        close(fd);
+        return -1;
+    }
+    syslog(LOG_INFO, "Listening on Unix socket %s", name);
+    return fd;
+}
+
 int main(int argc, char *argv[]) {
     int daemon_mode = 0;
-    if (argc > 1 && strcmp(argv[1], "-d") == 0) {
-        daemon_mode = 1;
+    const char *unix_socket_name = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "du:")) != -1) {
+        switch (opt) {
+        case 'd':
+            daemon_mode = 1;
+            break;
+        case 'u':
+            unix_socket_name = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d] [-u path | -u @name]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
     }
 
     if (daemon_mode) {
@@ -316,6 +393,19 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
+    // Local clients skip the TCP/IP stack through the Unix domain socket
+    if (unix_socket_name != NULL) {
+        unix_sockfd = open_unix_listener(unix_socket_name);
+        if (unix_sockfd == -1) {
+            cleanup(EXIT_FAILURE);
+        }
+    }
+    struct pollfd listen_fds[2] = {
+        { .fd = sockfd, .events = POLLIN },
+        { .fd = unix_sockfd, .events = POLLIN },
+    };
+    nfds_t listen_fd_count = (unix_sockfd >= 0) ? 2 : 1;
+
 #if USE_AESD_CHAR_DEVICE != 1
     // Dedicated thread to append timestamps
     pthread_t timestamp_thread;
@@ -326,10 +416,33 @@ int main(int argc, char *argv[]) {
 #endif
 
     // Accept connections in a loop
+    nfds_t next_listen_fd = 0;
     while (1) {
-        struct sockaddr_in client_addr;
+        // Wait for a connection on any listener
+        if (poll(listen_fds, listen_fd_count, -1) == -1) {
+            if (errno != EINTR) {
+                syslog(LOG_WARNING, "WARNING: Failed to poll, retrying ...");
+            }
+            continue;
+        }
+        // Start with a different listener every time, so a busy one cannot starve the other
+        nfds_t i;
+        int listen_fd = -1;
+        for (i = 0; i < listen_fd_count; i++) {
+            nfds_t candidate = (next_listen_fd + i) % listen_fd_count;
+            if (listen_fds[candidate].revents & POLLIN) {
+                listen_fd = listen_fds[candidate].fd;
+                next_listen_fd = (candidate + 1) % listen_fd_count;
+                break;
+            }
+        }
+        if (listen_fd == -1) {
+            continue;
+        }
+
+        struct sockaddr_storage client_addr;
         socklen_t client_addr_len = sizeof(client_addr);
-        int client_sockfd = accept(sockfd, (struct sockaddr*)&client_addr, &client_addr_len);
+        int client_sockfd = accept(listen_fd, (struct sockaddr*)&client_addr, &client_addr_len);
         if (client_sockfd == -1) {
             syslog(LOG_WARNING, "WARNING: Failed to accept, retrying ...");
             continue; // Continue accepting connections
@@ -342,7 +455,12 @@ int main(int argc, char *argv[]) {
         }
 
         // Log accepted connection
-        inet_ntop(AF_INET, &(client_addr.sin_addr), new_thread->client_data.client_ip, INET_ADDRSTRLEN);
+        if (client_addr.ss_family == AF_INET) {
+            inet_ntop(AF_INET, &((struct sockaddr_in *)&client_addr)->sin_addr, new_thread->client_data.client_ip, INET_ADDRSTRLEN);
+        }
+        else {
+            strcpy(new_thread->client_data.client_ip, "local");
+        }
         syslog(LOG_INFO, "Accepted connection from %s", new_thread->client_data.client_ip);
 
         new_thread->client_data.client_sockfd = client_sockfd;
@@ -0,0 +1,132 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "../../examples/systemcalls/systemcalls.h"
+
+#define BATCH_TEST_DIR "/tmp/aesd-systemcalls-batch-test"
+#define BATCH_TEST_COMMANDS 12
+
+/**
+* Each command registers itself in BATCH_TEST_DIR/running while it runs, and logs how many commands
+* it saw running there
+*/
+static char *const batch_test_counting_command[] = {
+    "/bin/sh", "-c",
+    "touch " BATCH_TEST_DIR "/running/$$; "
+    "ls " BATCH_TEST_DIR "/running | wc -l >> " BATCH_TEST_DIR "/seen; "
+    "sleep 0.2; "
+    "ls " BATCH_TEST_DIR "/running | wc -l >> " BATCH_TEST_DIR "/seen; "
+    "rm " BATCH_TEST_DIR "/running/$$",
+    NULL
+};
+
+/**
+* Run BATCH_TEST_COMMANDS counting commands with @param max_parallel.
+* @return the largest number of commands seen running at once
+*/
+static unsigned batch_test_max_running(unsigned max_parallel)
+{
+    char *const *commands[BATCH_TEST_COMMANDS];
+    struct exec_result results[BATCH_TEST_COMMANDS];
+    unsigned max_running = 0;
+    unsigned running;
+    FILE *seen;
+    size_t i;
+
+    TEST_ASSERT_EQUAL_INT(0, system("rm -rf " BATCH_TEST_DIR " && mkdir -p " BATCH_TEST_DIR "/running"));
+    for (i = 0; i < BATCH_TEST_COMMANDS; i++) {
+        commands[i] = batch_test_counting_command;
+    }
+    TEST_ASSERT_TRUE(do_exec_batch(commands, BATCH_TEST_COMMANDS, max_parallel, results));
+    for (i = 0; i < BATCH_TEST_COMMANDS; i++) {
+        TEST_ASSERT_TRUE(results[i].success);
+        TEST_ASSERT_GREATER_OR_EQUAL(200000000, results[i].elapsed_ns);
+    }
+    seen = fopen(BATCH_TEST_DIR "/seen", "r");
+    TEST_ASSERT_NOT_NULL(seen);
+    for (i = 0; fscanf(seen, "%u", &running) == 1; i++) {
+        if (running > max_running) {
+            max_running = running;
+        }
+    }
+    fclose(seen);
+    TEST_ASSERT_EQUAL_size_t(BATCH_TEST_COMMANDS * 2, i);
+    TEST_ASSERT_EQUAL_INT(0, system("rm -rf " BATCH_TEST_DIR));
+    return max_running;
+}
+
+void test_systemcalls_batch_max_parallel()
+{
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(1, batch_test_max_running(1), "max_parallel 1 runs commands one at a time");
+    // Each command runs for 200ms, long enough for the others of its group to start
+    TEST_ASSERT_EQUAL_UINT(3, batch_test_max_running(3));
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(BATCH_TEST_COMMANDS, batch_test_max_running(BATCH_TEST_COMMANDS * 2),
+            "max_parallel beyond the number of commands runs them all at once");
+}
+
+void test_systemcalls_batch_failures()
+{
+    char *const ok[] = { "/bin/true", NULL };
+    char *const exits[] = { "/bin/sh", "-c", "exit 3", NULL };
+    char *const missing[] = { "/nonexistent/aesd-command", NULL };
+    char *const killed[] = { "/bin/sh", "-c", "kill -9 $$", NULL };
+    char *const slow[] = { "/bin/sh", "-c", "sleep 0.3", NULL };
+    char *const *commands[] = { slow, exits, missing, killed, ok, ok };
+    struct exec_result results[6];
+    enum exec_method method;
+
+    for (method = EXEC_METHOD_SPAWN; method <= EXEC_METHOD_FORK; method++) {
+        set_exec_method(method);
+        memset(results, 0xa5, sizeof(results));
+        // Failures don't stop the rest of the batch, and results follow command order, not exit order
+        TEST_ASSERT_FALSE(do_exec_batch(commands, 6, 2, results));
+        TEST_ASSERT_TRUE(results[0].success);
+        TEST_ASSERT_GREATER_OR_EQUAL(300000000, results[0].elapsed_ns);
+        TEST_ASSERT_FALSE(results[1].success);
+        TEST_ASSERT_TRUE(WIFEXITED(results[1].status));
+        TEST_ASSERT_EQUAL_INT(3, WEXITSTATUS(results[1].status));
+        TEST_ASSERT_FALSE(results[2].success);
+        if (method == EXEC_METHOD_SPAWN) {
+            TEST_ASSERT_EQUAL_INT_MESSAGE(-1, results[2].status, "posix_spawn reports a missing command");
+        }
+        else {
+            TEST_ASSERT_TRUE(WIFEXITED(results[2].status));
+            TEST_ASSERT_EQUAL_INT(EXIT_FAILURE, WEXITSTATUS(results[2].status));
+        }
+        TEST_ASSERT_FALSE(results[3].success);
+        TEST_ASSERT_TRUE(WIFSIGNALED(results[3].status));
+        TEST_ASSERT_EQUAL_INT(SIGKILL, WTERMSIG(results[3].status));
+        TEST_ASSERT_TRUE(results[4].success);
+        TEST_ASSERT_EQUAL_INT(0, results[4].status);
+        TEST_ASSERT_TRUE(results[5].success);
+        TEST_ASSERT_LESS_THAN(results[0].elapsed_ns, results[5].elapsed_ns);
+    }
+    set_exec_method(EXEC_METHOD_SPAWN);
+
+    // Only successes
+    TEST_ASSERT_TRUE(do_exec_batch(&commands[4], 2, 0, results));
+    TEST_ASSERT_TRUE(results[0].success && results[1].success);
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_batch(commands, 0, 0, results), "an empty batch succeeds");
+}
+
+void test_systemcalls_batch_usage()
+{
+    char *const busy[] = { "/bin/sh", "-c", "i=0; while [ $i -lt 200000 ]; do i=$((i + 1)); done", NULL };
+    char *const idle[] = { "/bin/sh", "-c", "sleep 0.1", NULL };
+    char *const *commands[] = { busy, idle };
+    struct exec_result results[2];
+    uint64_t busy_cpu_us;
+
+    TEST_ASSERT_TRUE(do_exec_batch(commands, 2, 2, results));
+    // Resource usage is that of each command itself
+    busy_cpu_us = results[0].usage.ru_utime.tv_sec * 1000000ULL + results[0].usage.ru_utime.tv_usec;
+    TEST_ASSERT_GREATER_THAN(10000, busy_cpu_us);
+    TEST_ASSERT_LESS_THAN(busy_cpu_us / 2, results[1].usage.ru_utime.tv_sec * 1000000ULL +
+            results[1].usage.ru_utime.tv_usec);
+    TEST_ASSERT_GREATER_THAN(0, results[0].usage.ru_maxrss);
+    TEST_ASSERT_GREATER_THAN(0, results[1].usage.ru_maxrss);
+}
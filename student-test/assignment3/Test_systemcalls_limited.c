@@ -0,0 +1,103 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../../examples/systemcalls/systemcalls.h"
+
+void test_systemcalls_limited_timeout()
+{
+    char *const sleeper[] = { "/bin/sleep", "5", NULL };
+    char *const quick[] = { "/bin/sh", "-c", "exit 0", NULL };
+    struct exec_limits limits = { .timeout_ms = 100 };
+    struct exec_report report;
+
+    TEST_ASSERT_FALSE(do_exec_limited(sleeper, &limits, &report));
+    TEST_ASSERT_TRUE(report.timed_out);
+    TEST_ASSERT_FALSE(report.success);
+    TEST_ASSERT_TRUE(WIFSIGNALED(report.status));
+    TEST_ASSERT_EQUAL_INT(SIGKILL, WTERMSIG(report.status));
+    // Killed soon after the timeout rather than left to run for 5s
+    TEST_ASSERT_GREATER_OR_EQUAL(100000000, report.elapsed_ns);
+    TEST_ASSERT_LESS_THAN(2000000000, report.elapsed_ns);
+
+    limits.timeout_ms = 5000;
+    TEST_ASSERT_TRUE(do_exec_limited(quick, &limits, &report));
+    TEST_ASSERT_FALSE(report.timed_out);
+    TEST_ASSERT_TRUE(report.success);
+    TEST_ASSERT_EQUAL_INT(0, report.status);
+    TEST_ASSERT_LESS_THAN(2000000000, report.elapsed_ns);
+}
+
+void test_systemcalls_limited_no_limits()
+{
+    char *const exits[] = { "/bin/sh", "-c", "exit 4", NULL };
+    char *const quick[] = { "/bin/true", NULL };
+    struct exec_limits limits = { 0 };
+    struct exec_report report;
+
+    TEST_ASSERT_TRUE(do_exec_limited(quick, NULL, &report));
+    TEST_ASSERT_TRUE(do_exec_limited(quick, NULL, NULL));
+    TEST_ASSERT_TRUE(do_exec_limited(quick, &limits, NULL));
+    TEST_ASSERT_FALSE(do_exec_limited(exits, &limits, &report));
+    TEST_ASSERT_FALSE(report.timed_out);
+    TEST_ASSERT_TRUE(WIFEXITED(report.status));
+    TEST_ASSERT_EQUAL_INT(4, WEXITSTATUS(report.status));
+}
+
+void test_systemcalls_limited_rlimits()
+{
+    char *const check_nofile[] = { "/bin/sh", "-c", "test \"$(ulimit -n)\" = 17", NULL };
+    char *const large_write[] = { "/bin/sh", "-c", "exec head -c 100000 /dev/zero > /tmp/aesd-systemcalls-limited-test", NULL };
+    struct exec_rlimit nofile = { .resource = RLIMIT_NOFILE, .limit = { .rlim_cur = 17, .rlim_max = 17 } };
+    struct exec_rlimit fsize = { .resource = RLIMIT_FSIZE, .limit = { .rlim_cur = 4096, .rlim_max = 4096 } };
+    struct exec_rlimit invalid = { .resource = RLIMIT_NOFILE, .limit = { .rlim_cur = 32, .rlim_max = 16 } };
+    struct exec_limits limits = { .rlimits = &nofile, .rlimit_count = 1 };
+    struct exec_report report;
+    struct rlimit ours;
+
+    TEST_ASSERT_TRUE(do_exec_limited(check_nofile, &limits, &report));
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_limited(check_nofile, NULL, &report), "limits apply only to the child");
+    getrlimit(RLIMIT_NOFILE, &ours);
+    TEST_ASSERT_TRUE(ours.rlim_cur != 17);
+
+    // Writing past RLIMIT_FSIZE raises SIGXFSZ, with a timeout as well as the limit
+    limits.rlimits = &fsize;
+    limits.timeout_ms = 5000;
+    TEST_ASSERT_FALSE(do_exec_limited(large_write, &limits, &report));
+    TEST_ASSERT_FALSE(report.timed_out);
+    TEST_ASSERT_TRUE(WIFSIGNALED(report.status));
+    TEST_ASSERT_EQUAL_INT(SIGXFSZ, WTERMSIG(report.status));
+    unlink("/tmp/aesd-systemcalls-limited-test");
+
+    // A limit which can't be applied fails the command before it runs
+    limits.rlimits = &invalid;
+    limits.timeout_ms = 0;
+    TEST_ASSERT_FALSE(do_exec_limited(check_nofile, &limits, &report));
+    TEST_ASSERT_TRUE(WIFEXITED(report.status));
+    TEST_ASSERT_EQUAL_INT(EXIT_FAILURE, WEXITSTATUS(report.status));
+}
+
+void test_systemcalls_limited_cgroup()
+{
+    char *const quick[] = { "/bin/true", NULL };
+    struct exec_limits limits = { .cgroup = "/nonexistent/aesd-cgroup" };
+    struct exec_report report;
+
+    TEST_ASSERT_FALSE(do_exec_limited(quick, &limits, &report));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, report.status, "the command isn't started without its cgroup");
+    TEST_ASSERT_FALSE(report.success);
+}
+
+void test_systemcalls_limited_usage()
+{
+    char *const busy[] = { "/bin/sh", "-c", "i=0; while [ $i -lt 200000 ]; do i=$((i + 1)); done", NULL };
+    struct exec_report report;
+
+    TEST_ASSERT_TRUE(do_exec_limited(busy, NULL, &report));
+    TEST_ASSERT_GREATER_THAN(10000, report.usage.ru_utime.tv_sec * 1000000ULL + report.usage.ru_utime.tv_usec);
+    TEST_ASSERT_GREATER_THAN(0, report.usage.ru_maxrss);
+    TEST_ASSERT_GREATER_OR_EQUAL(report.usage.ru_utime.tv_sec * 1000000000ULL, report.elapsed_ns);
+}
@@ -0,0 +1,83 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../../examples/systemcalls/systemcalls.h"
+
+#define SPAWN_TEST_OUTPUT "/tmp/aesd-systemcalls-spawn-test.txt"
+
+/**
+* @return the first line of @param path, without its newline, in @param buf of @param size bytes
+*/
+static const char *spawn_test_read_line(const char *path, char *buf, size_t size)
+{
+    FILE *file = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(file, path);
+    if (fgets(buf, size, file) == NULL) {
+        buf[0] = '\0';
+    }
+    fclose(file);
+    buf[strcspn(buf, "\n")] = '\0';
+    return buf;
+}
+
+/**
+* The do_exec and do_exec_redirect checks of the assignment, run with the current exec method
+*/
+static void spawn_test_exec(void)
+{
+    char line[256];
+
+    TEST_ASSERT_TRUE(do_exec(1, "/bin/true"));
+    TEST_ASSERT_FALSE(do_exec(1, "/bin/false"));
+    TEST_ASSERT_TRUE(do_exec(3, "/bin/sh", "-c", "exit 0"));
+    TEST_ASSERT_FALSE(do_exec(3, "/bin/sh", "-c", "exit 3"));
+    TEST_ASSERT_FALSE_MESSAGE(do_exec(2, "echo", "relative"), "commands are not looked up in PATH");
+    TEST_ASSERT_FALSE(do_exec(1, "/nonexistent/aesd-command"));
+    TEST_ASSERT_FALSE_MESSAGE(do_exec(3, "/bin/sh", "-c", "kill -9 $$"), "a killed command fails");
+
+    TEST_ASSERT_TRUE(do_exec_redirect(SPAWN_TEST_OUTPUT, 2, "/bin/echo", "home is $HOME"));
+    TEST_ASSERT_EQUAL_STRING("home is $HOME", spawn_test_read_line(SPAWN_TEST_OUTPUT, line, sizeof(line)));
+    // Only standard out is redirected, and the file is truncated first
+    TEST_ASSERT_TRUE(do_exec_redirect(SPAWN_TEST_OUTPUT, 3, "/bin/sh", "-c", "echo out; echo err >&2"));
+    TEST_ASSERT_EQUAL_STRING("out", spawn_test_read_line(SPAWN_TEST_OUTPUT, line, sizeof(line)));
+    TEST_ASSERT_FALSE(do_exec_redirect(SPAWN_TEST_OUTPUT, 1, "/nonexistent/aesd-command"));
+    unlink(SPAWN_TEST_OUTPUT);
+}
+
+void test_systemcalls_spawn_default()
+{
+    TEST_ASSERT_EQUAL_INT_MESSAGE(EXEC_METHOD_SPAWN, get_exec_method(), "posix_spawn should be the default");
+    spawn_test_exec();
+}
+
+void test_systemcalls_spawn_fork_method()
+{
+    set_exec_method(EXEC_METHOD_FORK);
+    TEST_ASSERT_EQUAL_INT(EXEC_METHOD_FORK, get_exec_method());
+    spawn_test_exec();
+    set_exec_method(EXEC_METHOD_SPAWN);
+}
+
+void test_systemcalls_spawn_descriptors()
+{
+    char command[128];
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    int inherited = open("/dev/null", O_RDONLY);
+    enum exec_method method;
+
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, inherited);
+    // Both methods close our close-on-exec descriptors in the child and keep the others
+    for (method = EXEC_METHOD_SPAWN; method <= EXEC_METHOD_FORK; method++) {
+        set_exec_method(method);
+        snprintf(command, sizeof(command), "test ! -e /proc/self/fd/%d && test -e /proc/self/fd/%d", fd, inherited);
+        TEST_ASSERT_TRUE(do_exec(3, "/bin/sh", "-c", command));
+    }
+    set_exec_method(EXEC_METHOD_SPAWN);
+    close(fd);
+    close(inherited);
+}
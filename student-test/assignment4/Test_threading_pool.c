@@ -0,0 +1,151 @@
+#include "unity.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "../../examples/threading/threading.h"
+
+#define POOL_TEST_TASKS 32
+
+static uint64_t pool_test_ms_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000ULL + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static bool pool_test_done(struct thread_pool *pool, struct thread_pool_task *task)
+{
+    bool done;
+    pthread_mutex_lock(&pool->lock);
+    done = task->done;
+    pthread_mutex_unlock(&pool->lock);
+    return done;
+}
+
+void test_threading_pool_timer_order()
+{
+    struct thread_pool *pool = thread_pool_create(1, POOL_TEST_TASKS);
+    pthread_mutex_t mutex[POOL_TEST_TASKS];
+    struct thread_pool_task *task[POOL_TEST_TASKS];
+    struct timespec start;
+    size_t done_count = 0;
+    bool in_order = true;
+    size_t i;
+
+    TEST_ASSERT_NOT_NULL(pool);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // Deadlines 5ms apart, added out of order so the heap has to sift both ways.  Task i is due
+    // after (i * 13 % POOL_TEST_TASKS) * 5ms, 13 being coprime with the task count.
+    for (i = 0; i < POOL_TEST_TASKS; i++) {
+        pthread_mutex_init(&mutex[i], NULL);
+        task[i] = thread_pool_start_obtaining_mutex(pool, &mutex[i], (i * 13 % POOL_TEST_TASKS) * 5, 0);
+        TEST_ASSERT_NOT_NULL(task[i]);
+    }
+    // With one worker tasks complete in deadline order, so the completed tasks are always those
+    // with the earliest deadlines
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        done_count = 0;
+        for (i = 0; i < POOL_TEST_TASKS; i++) {
+            done_count += task[i]->done;
+        }
+        for (i = 0; i < POOL_TEST_TASKS; i++) {
+            if (((i * 13 % POOL_TEST_TASKS) < done_count) && !task[i]->done) {
+                in_order = false;
+            }
+        }
+        if (done_count == POOL_TEST_TASKS) {
+            break;
+        }
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    TEST_ASSERT_GREATER_OR_EQUAL((POOL_TEST_TASKS - 1) * 5, pool_test_ms_since(&start));
+    for (i = 0; i < POOL_TEST_TASKS; i++) {
+        TEST_ASSERT_TRUE(thread_pool_join(task[i]));
+        pthread_mutex_destroy(&mutex[i]);
+    }
+    thread_pool_destroy(pool);
+    TEST_ASSERT_TRUE_MESSAGE(in_order, "a task completed before one with an earlier deadline");
+}
+
+void test_threading_pool_delays()
+{
+    struct thread_pool *pool = thread_pool_create(2, 4);
+    pthread_mutex_t mutex_late = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_t mutex_early = PTHREAD_MUTEX_INITIALIZER;
+    struct thread_pool_task *late;
+    struct thread_pool_task *early;
+    struct timespec start;
+
+    TEST_ASSERT_NOT_NULL(pool);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    late = thread_pool_start_obtaining_mutex(pool, &mutex_late, 300, 50);
+    early = thread_pool_start_obtaining_mutex(pool, &mutex_early, 0, 50);
+    TEST_ASSERT_NOT_NULL(late);
+    TEST_ASSERT_NOT_NULL(early);
+    // A task added after one with a later deadline doesn't wait for it
+    TEST_ASSERT_TRUE(thread_pool_join(early));
+    TEST_ASSERT_GREATER_OR_EQUAL(50, pool_test_ms_since(&start));
+    TEST_ASSERT_FALSE(pool_test_done(pool, late));
+    // Neither the obtain delay nor the hold time is cut short
+    TEST_ASSERT_TRUE(thread_pool_join(late));
+    TEST_ASSERT_GREATER_OR_EQUAL(350, pool_test_ms_since(&start));
+    thread_pool_destroy(pool);
+}
+
+void test_threading_pool_contended_mutex()
+{
+    struct thread_pool *pool = thread_pool_create(2, 4);
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    struct thread_pool_task *first;
+    struct thread_pool_task *second;
+    struct timespec hold = { .tv_sec = 0, .tv_nsec = 100000000 };
+    struct timespec start;
+
+    TEST_ASSERT_NOT_NULL(pool);
+    // Held by another task of the pool, the second task waits for the first to release it
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    first = thread_pool_start_obtaining_mutex(pool, &mutex, 0, 100);
+    second = thread_pool_start_obtaining_mutex(pool, &mutex, 10, 100);
+    TEST_ASSERT_TRUE(thread_pool_join(second));
+    TEST_ASSERT_TRUE(pool_test_done(pool, first));
+    TEST_ASSERT_GREATER_OR_EQUAL(200, pool_test_ms_since(&start));
+    TEST_ASSERT_TRUE(thread_pool_join(first));
+
+    // Held outside the pool, the task retries until the mutex is free
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(&mutex);
+    first = thread_pool_start_obtaining_mutex(pool, &mutex, 0, 0);
+    nanosleep(&hold, NULL);
+    TEST_ASSERT_FALSE(pool_test_done(pool, first));
+    pthread_mutex_unlock(&mutex);
+    TEST_ASSERT_TRUE(thread_pool_join(first));
+    // Retries back off to at most 64ms apart
+    TEST_ASSERT_LESS_THAN(1000, pool_test_ms_since(&start));
+    thread_pool_destroy(pool);
+}
+
+void test_threading_pool_slots()
+{
+    struct thread_pool *pool = thread_pool_create(1, 2);
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    struct thread_pool_task *task[2];
+
+    TEST_ASSERT_NULL(thread_pool_create(0, 2));
+    TEST_ASSERT_NULL(thread_pool_create(1, 0));
+    TEST_ASSERT_NOT_NULL(pool);
+    task[0] = thread_pool_start_obtaining_mutex(pool, &mutex, 10, 0);
+    task[1] = thread_pool_start_obtaining_mutex(pool, &mutex, 10, 0);
+    TEST_ASSERT_NOT_NULL(task[0]);
+    TEST_ASSERT_NOT_NULL(task[1]);
+    TEST_ASSERT_NULL_MESSAGE(thread_pool_start_obtaining_mutex(pool, &mutex, 0, 0), "all task slots are in use");
+    // Joining a task returns its slot
+    TEST_ASSERT_TRUE(thread_pool_join(task[0]));
+    task[0] = thread_pool_start_obtaining_mutex(pool, &mutex, 0, 0);
+    TEST_ASSERT_NOT_NULL(task[0]);
+    TEST_ASSERT_TRUE(thread_pool_join(task[0]));
+    TEST_ASSERT_TRUE(thread_pool_join(task[1]));
+    thread_pool_destroy(pool);
+}
@@ -0,0 +1,100 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <string.h>
+#include "../../aesd-char-driver/aesd-circular-buffer.h"
+
+static const char inline_test_data[] =
+    "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+void test_circular_buffer_inline_boundary()
+{
+    struct aesd_buffer_entry entry;
+    _Static_assert(sizeof(inline_test_data) > AESD_BUFFER_ENTRY_INLINE_SIZE + 1,
+            "inline_test_data should be longer than the inline storage");
+    TEST_ASSERT_TRUE(aesd_buffer_entry_set_inline(&entry, inline_test_data, AESD_BUFFER_ENTRY_INLINE_SIZE));
+    TEST_ASSERT_TRUE(aesd_buffer_entry_is_inline(&entry));
+    TEST_ASSERT_EQUAL_PTR(entry.inline_data, entry.buffptr);
+    TEST_ASSERT_EQUAL_size_t(AESD_BUFFER_ENTRY_INLINE_SIZE, entry.size);
+    TEST_ASSERT_EQUAL_MEMORY(inline_test_data, entry.buffptr, AESD_BUFFER_ENTRY_INLINE_SIZE);
+
+    TEST_ASSERT_TRUE(aesd_buffer_entry_set_inline(&entry, inline_test_data, 0));
+    TEST_ASSERT_TRUE(aesd_buffer_entry_is_inline(&entry));
+    TEST_ASSERT_EQUAL_size_t(0, entry.size);
+}
+
+void test_circular_buffer_inline_too_large()
+{
+    struct aesd_buffer_entry entry;
+    entry.buffptr = inline_test_data;
+    entry.size = 5;
+    entry.stream_offs = 77;
+    memset(entry.inline_data, 'x', sizeof(entry.inline_data));
+    TEST_ASSERT_FALSE_MESSAGE(aesd_buffer_entry_set_inline(&entry, inline_test_data, AESD_BUFFER_ENTRY_INLINE_SIZE + 1),
+            "one byte over the inline size should be rejected");
+    // A rejected entry is left unchanged
+    TEST_ASSERT_FALSE(aesd_buffer_entry_is_inline(&entry));
+    TEST_ASSERT_EQUAL_PTR(inline_test_data, entry.buffptr);
+    TEST_ASSERT_EQUAL_size_t(5, entry.size);
+    TEST_ASSERT_EQUAL_UINT64(77, entry.stream_offs);
+    TEST_ASSERT_EQUAL_UINT8('x', entry.inline_data[0]);
+    TEST_ASSERT_EQUAL_UINT8('x', entry.inline_data[AESD_BUFFER_ENTRY_INLINE_SIZE - 1]);
+}
+
+void test_circular_buffer_inline_copy()
+{
+    struct aesd_buffer_entry src;
+    struct aesd_buffer_entry dst;
+    TEST_ASSERT_TRUE(aesd_buffer_entry_set_inline(&src, inline_test_data, AESD_BUFFER_ENTRY_INLINE_SIZE));
+    src.stream_offs = 1234;
+    memset(&dst, 0, sizeof(dst));
+    aesd_buffer_entry_copy(&dst, &src);
+    // The copy points at its own inline data, so it outlives changes to the source
+    TEST_ASSERT_TRUE(aesd_buffer_entry_is_inline(&dst));
+    TEST_ASSERT_EQUAL_PTR(dst.inline_data, dst.buffptr);
+    TEST_ASSERT_EQUAL_size_t(AESD_BUFFER_ENTRY_INLINE_SIZE, dst.size);
+    TEST_ASSERT_EQUAL_UINT64(1234, dst.stream_offs);
+    memset(src.inline_data, 0, sizeof(src.inline_data));
+    TEST_ASSERT_EQUAL_MEMORY(inline_test_data, dst.buffptr, AESD_BUFFER_ENTRY_INLINE_SIZE);
+
+    // An entry referencing caller memory is copied as is
+    src.buffptr = inline_test_data;
+    src.size = sizeof(inline_test_data);
+    aesd_buffer_entry_copy(&dst, &src);
+    TEST_ASSERT_FALSE(aesd_buffer_entry_is_inline(&dst));
+    TEST_ASSERT_EQUAL_PTR(inline_test_data, dst.buffptr);
+    TEST_ASSERT_EQUAL_size_t(sizeof(inline_test_data), dst.size);
+}
+
+void test_circular_buffer_inline_add_entry()
+{
+    struct aesd_circular_buffer buffer;
+    struct aesd_buffer_entry entry;
+    size_t entry_offset = 0;
+    unsigned i;
+    aesd_circular_buffer_init(&buffer);
+    // Inline entries are copied into the buffer, and return nothing to free when overwritten
+    for (i = 0; i < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; i++) {
+        TEST_ASSERT_TRUE(aesd_buffer_entry_set_inline(&entry, inline_test_data, AESD_BUFFER_ENTRY_INLINE_SIZE));
+        TEST_ASSERT_NULL(aesd_circular_buffer_add_entry(&buffer, &entry));
+        memset(entry.inline_data, 0, sizeof(entry.inline_data));
+    }
+    TEST_ASSERT_TRUE(buffer.full);
+    TEST_ASSERT_TRUE(aesd_buffer_entry_is_inline(aesd_circular_buffer_get_entry(&buffer, 0)));
+    TEST_ASSERT_EQUAL_size_t(AESD_BUFFER_ENTRY_INLINE_SIZE * AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+            aesd_circular_buffer_entries_total_size(&buffer));
+    TEST_ASSERT_EQUAL_PTR(aesd_circular_buffer_get_entry(&buffer, 1),
+            aesd_circular_buffer_find_entry_offset_for_fpos(&buffer, AESD_BUFFER_ENTRY_INLINE_SIZE + 3, &entry_offset));
+    TEST_ASSERT_EQUAL_size_t(3, entry_offset);
+    TEST_ASSERT_EQUAL_MEMORY(inline_test_data, aesd_circular_buffer_get_entry(&buffer, 1)->buffptr,
+            AESD_BUFFER_ENTRY_INLINE_SIZE);
+
+    // Overwriting an inline entry with one in caller memory returns nothing, the reverse returns the caller memory
+    entry.buffptr = inline_test_data;
+    entry.size = sizeof(inline_test_data);
+    TEST_ASSERT_NULL(aesd_circular_buffer_add_entry(&buffer, &entry));
+    for (i = 1; i < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; i++) {
+        TEST_ASSERT_TRUE(aesd_buffer_entry_set_inline(&entry, inline_test_data, 1));
+        TEST_ASSERT_NULL(aesd_circular_buffer_add_entry(&buffer, &entry));
+    }
+    TEST_ASSERT_EQUAL_PTR(inline_test_data, aesd_circular_buffer_add_entry(&buffer, &entry));
+}
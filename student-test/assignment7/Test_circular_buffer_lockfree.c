@@ -0,0 +1,193 @@
+#include "unity.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "../../aesd-char-driver/aesd-circular-buffer-lockfree.h"
+
+typedef bool (*lf_add_fn)(struct aesd_lf_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry);
+
+/**
+* @return the result of adding the inline entry "write<seq>\n" to @param buffer with @param add
+*/
+static bool lf_add_write(struct aesd_lf_circular_buffer *buffer, lf_add_fn add, unsigned seq)
+{
+    struct aesd_buffer_entry entry;
+    char data[AESD_BUFFER_ENTRY_INLINE_SIZE];
+    int size = snprintf(data, sizeof(data), "write%u\n", seq);
+    TEST_ASSERT_TRUE(aesd_buffer_entry_set_inline(&entry, data, size));
+    return add(buffer, &entry);
+}
+
+/**
+* Remove the oldest entry from @param buffer and check it is "write<seq>\n"
+*/
+static void lf_check_remove(struct aesd_lf_circular_buffer *buffer, unsigned seq)
+{
+    struct aesd_buffer_entry entry;
+    char expected[AESD_BUFFER_ENTRY_INLINE_SIZE];
+    int size = snprintf(expected, sizeof(expected), "write%u\n", seq);
+    TEST_ASSERT_TRUE(aesd_lf_circular_buffer_remove_entry(buffer, &entry));
+    TEST_ASSERT_EQUAL_size_t(size, entry.size);
+    TEST_ASSERT_TRUE(aesd_buffer_entry_is_inline(&entry));
+    TEST_ASSERT_EQUAL_MEMORY(expected, entry.buffptr, size);
+}
+
+static void lf_check_empty(struct aesd_lf_circular_buffer *buffer)
+{
+    struct aesd_buffer_entry entry;
+    size_t entry_offset = 1234;
+    TEST_ASSERT_FALSE(aesd_lf_circular_buffer_remove_entry(buffer, &entry));
+    TEST_ASSERT_NULL(aesd_lf_circular_buffer_find_entry_offset_for_fpos(buffer, 0, &entry_offset));
+    TEST_ASSERT_EQUAL_size_t(1234, entry_offset);
+    TEST_ASSERT_EQUAL_size_t(0, aesd_lf_circular_buffer_entries_total_size(buffer));
+}
+
+/**
+* Fill an empty @param buffer with @param add, check a full ring rejects the next entry and
+* drain it in order
+*/
+static void lf_check_full(lf_add_fn add)
+{
+    struct aesd_lf_circular_buffer ring;
+    struct aesd_lf_circular_buffer *buffer = &ring;
+    unsigned seq;
+    aesd_lf_circular_buffer_init(buffer);
+    lf_check_empty(buffer);
+    for (seq = 0; seq < AESD_LF_CIRCULAR_BUFFER_SIZE; seq++) {
+        TEST_ASSERT_TRUE(lf_add_write(buffer, add, seq));
+    }
+    TEST_ASSERT_FALSE_MESSAGE(lf_add_write(buffer, add, seq), "a full ring should reject entries");
+    // The rejected entry overwrote nothing
+    lf_check_remove(buffer, 0);
+    TEST_ASSERT_TRUE_MESSAGE(lf_add_write(buffer, add, seq), "removing an entry should free a slot");
+    for (seq = 1; seq <= AESD_LF_CIRCULAR_BUFFER_SIZE; seq++) {
+        lf_check_remove(buffer, seq);
+    }
+    lf_check_empty(buffer);
+}
+
+void test_circular_buffer_lockfree_spsc_full_empty()
+{
+    lf_check_full(aesd_lf_circular_buffer_add_entry_spsc);
+}
+
+void test_circular_buffer_lockfree_mpsc_full_empty()
+{
+    lf_check_full(aesd_lf_circular_buffer_add_entry_mpsc);
+}
+
+/**
+* Keep @param buffer half full over several laps of the ring, checking the offset search and
+* total size against the entries held at each step
+*/
+static void lf_check_wraparound(lf_add_fn add)
+{
+    struct aesd_lf_circular_buffer ring;
+    struct aesd_lf_circular_buffer *buffer = &ring;
+    const unsigned held = AESD_LF_CIRCULAR_BUFFER_SIZE / 2 + 1;
+    unsigned next_add = 0;
+    unsigned next_remove = 0;
+    aesd_lf_circular_buffer_init(buffer);
+    while (next_remove < AESD_LF_CIRCULAR_BUFFER_SIZE * 5) {
+        size_t total = 0;
+        unsigned seq;
+        while (next_add - next_remove < held) {
+            TEST_ASSERT_TRUE(lf_add_write(buffer, add, next_add++));
+        }
+        for (seq = next_remove; seq < next_add; seq++) {
+            char expected[AESD_BUFFER_ENTRY_INLINE_SIZE];
+            int size = snprintf(expected, sizeof(expected), "write%u\n", seq);
+            size_t entry_offset = 0;
+            struct aesd_buffer_entry *entry;
+            // The last byte of each entry is found at its offset from the oldest entry held
+            entry = aesd_lf_circular_buffer_find_entry_offset_for_fpos(buffer, total + size - 1, &entry_offset);
+            TEST_ASSERT_NOT_NULL(entry);
+            TEST_ASSERT_EQUAL_size_t(size - 1, entry_offset);
+            TEST_ASSERT_EQUAL_MEMORY(expected, entry->buffptr, size);
+            total += size;
+        }
+        TEST_ASSERT_NULL(aesd_lf_circular_buffer_find_entry_offset_for_fpos(buffer, total, NULL));
+        TEST_ASSERT_EQUAL_size_t(total, aesd_lf_circular_buffer_entries_total_size(buffer));
+        lf_check_remove(buffer, next_remove++);
+        lf_check_remove(buffer, next_remove++);
+        lf_check_remove(buffer, next_remove++);
+    }
+}
+
+void test_circular_buffer_lockfree_spsc_wraparound()
+{
+    lf_check_wraparound(aesd_lf_circular_buffer_add_entry_spsc);
+}
+
+void test_circular_buffer_lockfree_mpsc_wraparound()
+{
+    lf_check_wraparound(aesd_lf_circular_buffer_add_entry_mpsc);
+}
+
+#define LF_TEST_PRODUCERS 4
+#define LF_TEST_WRITES_PER_PRODUCER 20000
+
+struct lf_producer
+{
+    pthread_t thread;
+    struct aesd_lf_circular_buffer *buffer;
+    unsigned id;
+};
+
+/**
+* Add LF_TEST_WRITES_PER_PRODUCER entries of 8 bytes holding the producer id and a counter,
+* retrying while the ring is full
+*/
+static void *lf_producer_thread(void *arg)
+{
+    struct lf_producer *producer = arg;
+    unsigned count;
+    for (count = 0; count < LF_TEST_WRITES_PER_PRODUCER; count++) {
+        struct aesd_buffer_entry entry;
+        uint32_t data[2] = { producer->id, count };
+        aesd_buffer_entry_set_inline(&entry, (const char *)data, sizeof(data));
+        while (!aesd_lf_circular_buffer_add_entry_mpsc(producer->buffer, &entry)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void test_circular_buffer_lockfree_mpsc_threads()
+{
+    struct aesd_lf_circular_buffer ring;
+    struct aesd_lf_circular_buffer *buffer = &ring;
+    struct lf_producer producer[LF_TEST_PRODUCERS];
+    unsigned next_count[LF_TEST_PRODUCERS] = { 0 };
+    unsigned removed = 0;
+    unsigned i;
+    aesd_lf_circular_buffer_init(buffer);
+    for (i = 0; i < LF_TEST_PRODUCERS; i++) {
+        producer[i].buffer = buffer;
+        producer[i].id = i;
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&producer[i].thread, NULL, lf_producer_thread, &producer[i]));
+    }
+    // Every entry arrives exactly once, and each producer's entries arrive in the order it added them
+    while (removed < LF_TEST_PRODUCERS * LF_TEST_WRITES_PER_PRODUCER) {
+        struct aesd_buffer_entry entry;
+        uint32_t data[2];
+        if (!aesd_lf_circular_buffer_remove_entry(buffer, &entry)) {
+            sched_yield();
+            continue;
+        }
+        TEST_ASSERT_EQUAL_size_t(sizeof(data), entry.size);
+        memcpy(data, entry.buffptr, sizeof(data));
+        TEST_ASSERT_LESS_THAN(LF_TEST_PRODUCERS, data[0]);
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(next_count[data[0]], data[1], "entries of one producer out of order");
+        next_count[data[0]]++;
+        removed++;
+    }
+    for (i = 0; i < LF_TEST_PRODUCERS; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_join(producer[i].thread, NULL));
+        TEST_ASSERT_EQUAL_UINT(LF_TEST_WRITES_PER_PRODUCER, next_count[i]);
+    }
+    lf_check_empty(buffer);
+}
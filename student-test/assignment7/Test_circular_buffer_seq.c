@@ -0,0 +1,144 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../../aesd-char-driver/aesd-circular-buffer.h"
+
+/**
+* Add writes "write0\n", "write1\n", ... with sequence numbers first_seq .. first_seq + count - 1
+* to @param buffer, inline so there is nothing to free
+*/
+static void add_writes(struct aesd_circular_buffer *buffer, unsigned first_seq, unsigned count)
+{
+    unsigned seq;
+    for (seq = first_seq; seq < first_seq + count; seq++) {
+        struct aesd_buffer_entry entry;
+        char data[AESD_BUFFER_ENTRY_INLINE_SIZE];
+        int size = snprintf(data, sizeof(data), "write%u\n", seq);
+        TEST_ASSERT_TRUE(aesd_buffer_entry_set_inline(&entry, data, size));
+        TEST_ASSERT_NULL(aesd_circular_buffer_add_entry(buffer, &entry));
+    }
+}
+
+/**
+* @return the bytes written by add_writes for sequence numbers @param first_seq up to but not
+* including @param seq
+*/
+static size_t writes_size(unsigned first_seq, unsigned seq)
+{
+    size_t size = 0;
+    char data[AESD_BUFFER_ENTRY_INLINE_SIZE];
+    for (; first_seq < seq; first_seq++) {
+        size += snprintf(data, sizeof(data), "write%u\n", first_seq);
+    }
+    return size;
+}
+
+/**
+* Check the entry at @param seq holds the write added with that sequence number and starts
+* @param expected_char_offset bytes into the buffer
+*/
+static void check_seq(struct aesd_circular_buffer *buffer, uint64_t seq, size_t expected_char_offset)
+{
+    char expected[AESD_BUFFER_ENTRY_INLINE_SIZE];
+    size_t char_offset = SIZE_MAX;
+    size_t entry_offset = SIZE_MAX;
+    int size = snprintf(expected, sizeof(expected), "write%u\n", (unsigned)seq);
+    struct aesd_buffer_entry *entry = aesd_circular_buffer_find_entry_for_seq(buffer, seq, &char_offset);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL_size_t(size, entry->size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, entry->buffptr, size);
+    TEST_ASSERT_EQUAL_size_t(expected_char_offset, char_offset);
+    // The returned offset is the one aesd_circular_buffer_find_entry_offset_for_fpos needs to find it
+    TEST_ASSERT_EQUAL_PTR(entry, aesd_circular_buffer_find_entry_offset_for_fpos(buffer, char_offset, &entry_offset));
+    TEST_ASSERT_EQUAL_size_t(0, entry_offset);
+}
+
+void test_circular_buffer_seq_empty()
+{
+    struct aesd_circular_buffer buffer;
+    size_t char_offset = 1234;
+    aesd_circular_buffer_init(&buffer);
+    TEST_ASSERT_EQUAL_UINT8(0, aesd_circular_buffer_entry_count(&buffer));
+    TEST_ASSERT_NULL(aesd_circular_buffer_get_entry(&buffer, 0));
+    TEST_ASSERT_NULL(aesd_circular_buffer_find_entry_for_seq(&buffer, 0, &char_offset));
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(1234, char_offset, "char_offset_rtn should only be set when found");
+}
+
+void test_circular_buffer_seq_partial()
+{
+    struct aesd_circular_buffer buffer;
+    unsigned seq;
+    size_t char_offset = 0;
+    aesd_circular_buffer_init(&buffer);
+    add_writes(&buffer, 0, 3);
+    TEST_ASSERT_EQUAL_UINT8(3, aesd_circular_buffer_entry_count(&buffer));
+    for (seq = 0; seq < 3; seq++) {
+        check_seq(&buffer, seq, writes_size(0, seq));
+        TEST_ASSERT_EQUAL_PTR(aesd_circular_buffer_find_entry_for_seq(&buffer, seq, NULL),
+                aesd_circular_buffer_get_entry(&buffer, seq));
+    }
+    TEST_ASSERT_NULL_MESSAGE(aesd_circular_buffer_get_entry(&buffer, 3), "past the newest entry");
+    TEST_ASSERT_NULL_MESSAGE(aesd_circular_buffer_find_entry_for_seq(&buffer, 3, &char_offset),
+            "not yet added");
+    TEST_ASSERT_NULL(aesd_circular_buffer_find_entry_for_seq(&buffer, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - 1,
+            &char_offset));
+}
+
+void test_circular_buffer_seq_full()
+{
+    struct aesd_circular_buffer buffer;
+    unsigned seq;
+    aesd_circular_buffer_init(&buffer);
+    add_writes(&buffer, 0, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+    TEST_ASSERT_TRUE(buffer.full);
+    TEST_ASSERT_EQUAL_UINT8(AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, aesd_circular_buffer_entry_count(&buffer));
+    TEST_ASSERT_EQUAL_UINT64(0, buffer.out_seq);
+    for (seq = 0; seq < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; seq++) {
+        check_seq(&buffer, seq, writes_size(0, seq));
+    }
+    TEST_ASSERT_NULL(aesd_circular_buffer_get_entry(&buffer, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED));
+    TEST_ASSERT_NULL(aesd_circular_buffer_find_entry_for_seq(&buffer, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+            NULL));
+}
+
+void test_circular_buffer_seq_wraparound()
+{
+    struct aesd_circular_buffer buffer;
+    const unsigned total = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED * 2 + 3;
+    const unsigned oldest = total - AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    unsigned seq;
+    size_t char_offset = 0;
+    aesd_circular_buffer_init(&buffer);
+    add_writes(&buffer, 0, total);
+    TEST_ASSERT_EQUAL_UINT64(oldest, buffer.out_seq);
+    TEST_ASSERT_EQUAL_UINT8(AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, aesd_circular_buffer_entry_count(&buffer));
+    // Evicted entries are gone, including the one just before out_seq
+    TEST_ASSERT_NULL(aesd_circular_buffer_find_entry_for_seq(&buffer, 0, &char_offset));
+    TEST_ASSERT_NULL(aesd_circular_buffer_find_entry_for_seq(&buffer, oldest - 1, &char_offset));
+    // Offsets are relative to the oldest entry still held, which is at index 0 of get_entry
+    for (seq = oldest; seq < total; seq++) {
+        check_seq(&buffer, seq, writes_size(oldest, seq));
+        TEST_ASSERT_EQUAL_PTR(aesd_circular_buffer_find_entry_for_seq(&buffer, seq, NULL),
+                aesd_circular_buffer_get_entry(&buffer, seq - oldest));
+        TEST_ASSERT_EQUAL_UINT64(writes_size(0, seq),
+                aesd_circular_buffer_get_entry(&buffer, seq - oldest)->stream_offs);
+    }
+}
+
+void test_circular_buffer_seq_past_out_seq()
+{
+    struct aesd_circular_buffer buffer;
+    size_t char_offset = 1234;
+    aesd_circular_buffer_init(&buffer);
+    add_writes(&buffer, 0, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED + 4);
+    TEST_ASSERT_NULL(aesd_circular_buffer_find_entry_for_seq(&buffer,
+            buffer.out_seq + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, &char_offset));
+    TEST_ASSERT_NULL(aesd_circular_buffer_find_entry_for_seq(&buffer,
+            buffer.out_seq + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED + 1, &char_offset));
+    // Far enough past out_seq that seq - out_seq would wrap if computed the other way round
+    TEST_ASSERT_NULL(aesd_circular_buffer_find_entry_for_seq(&buffer, UINT64_MAX, &char_offset));
+    TEST_ASSERT_EQUAL_size_t(1234, char_offset);
+    check_seq(&buffer, buffer.out_seq + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - 1,
+            writes_size(buffer.out_seq, buffer.out_seq + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - 1));
+}